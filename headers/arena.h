@@ -0,0 +1,35 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#define ARENA_ALIGNMENT 16
+
+// Reset by every draw and step: the sorted props of a draw take 60 KiB
+// with MAX_PROPS props, the visible props and line of sight queries of a
+// step 41 KiB with MAX_ENEMIES enemies (2 KiB at most measured on the
+// shipped map)
+#define FRAME_ARENA_SIZE (128 * 1024)
+
+// Bump allocator for scratch memory: allocations only move an offset
+// forward and a reset releases everything at once. Each arena belongs to a
+// single thread, none of this is synchronized.
+typedef struct {
+    char* base;
+    size_t capacity;
+    size_t used;
+    size_t high_water; // Most bytes ever in use between two resets
+    unsigned long failures;
+} arena_t;
+
+// ------------------------
+// Functions
+// ------------------------
+
+bool arena_init(arena_t* arena, size_t capacity);
+void* arena_alloc(arena_t* arena, size_t size);
+void arena_reset(arena_t* arena);
+void arena_free(arena_t* arena);
+
+#endif
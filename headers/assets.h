@@ -0,0 +1,89 @@
+#ifndef ASSETS_H
+#define ASSETS_H
+
+#include <SDL2/SDL.h>
+#include <SDL2/SDL_render.h>
+#include <SDL2/SDL_surface.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#define ASSET_BUNDLE_MAGIC "RCBUNDLE"
+#define ASSET_BUNDLE_VERSION 1
+#define ASSET_NAME_LENGTH 64
+
+typedef enum {
+    ASSET_WALLS,
+    ASSET_GUN,
+    ASSET_WOODEN_BARREL,
+    ASSET_IRON_BARREL,
+    ASSET_DINNER_TABLE,
+    ASSET_FURNACE,
+    ASSET_ARMOR,
+    ASSET_WELLWATER,
+    ASSET_PILLAR,
+    ASSET_SOLDIER,
+    ASSET_FONT,
+    ASSET_COUNT,
+    ASSET_NONE = -1
+} asset_id;
+
+typedef enum { ASSET_IMAGE, ASSET_BLOB } asset_kind;
+
+// Opaque texels of a texture column, from row start to row end - 1
+typedef struct {
+    Uint16 start;
+    Uint16 end;
+} texel_run_t;
+
+typedef struct {
+    const char* name; // File name, relative to the asset root
+    asset_kind kind;
+    SDL_Surface* surface; // Decoded ARGB8888 pixels (images only)
+    SDL_Texture* texture; // Renderer copy of the surface (images only)
+    Uint8* rows;          // Palette index of every texel, row by row (images only)
+    Uint8* columns;       // Same indices transposed: a texture column is contiguous
+    texel_run_t* runs;    // Opaque runs of every column, top to bottom (images only)
+    Uint32* column_runs;  // First run of each column in runs, and one past the last
+    void* data;           // Raw file content (blobs only)
+    size_t size;
+    bool mapped; // Pixels or data point into the mmap-ed bundle
+} asset_t;
+
+// ----------------------------------------------------------
+// Bundle layout: header, entry table, then 64-byte aligned
+// payloads (ARGB8888 pixels for images, raw bytes for blobs)
+// ----------------------------------------------------------
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t count;
+} asset_bundle_header_t;
+
+typedef struct {
+    char name[ASSET_NAME_LENGTH];
+    uint32_t kind;
+    uint32_t width;
+    uint32_t height;
+    uint32_t pitch;
+    uint64_t offset; // From the beginning of the file
+    uint64_t size;
+} asset_bundle_entry_t;
+
+// ------------------------
+// Global variables
+// ------------------------
+
+extern asset_t assets[ASSET_COUNT];
+
+// ------------------------
+// Functions
+// ------------------------
+
+bool load_assets(const char* root, int workers);
+bool load_asset_bundle(const char* path);
+bool write_asset_bundle(const char* path);
+bool asset_opaque(const asset_t* asset, int x, int y);
+void free_assets();
+
+#endif
@@ -0,0 +1,20 @@
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+#include <SDL2/SDL.h>
+#include <stdbool.h>
+
+#define CAPTURE_RING_SIZE 8 // Frames buffered between the game and the writer
+
+typedef enum { CAPTURE_PPM, CAPTURE_Y4M } capture_format;
+
+// ------------------------
+// Functions
+// ------------------------
+
+bool capture_start(const char* path, int width, int height, int fps);
+Uint32* capture_acquire();
+void capture_submit();
+void capture_stop();
+
+#endif
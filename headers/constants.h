@@ -5,12 +5,14 @@
 #define TILE_HEIGHT 64
 #define TEXTURE_WIDTH 64
 #define TEXTURE_HEIGHT 64
-#define MAP_WIDTH 21
-#define MAP_HEIGHT 21
 #define STEP_FORWARD 5
 #define STEP_SIDE 5
 #define DELTA_TIME 10
+#define ENEMY_STEP 2
 #define ANGLE_STEP DEG_TO_RAG(10)
+#define MAX_RAY_STEPS 30               // Grid lines a ray crosses before giving up
+#define FOG_DISTANCE (16 * TILE_WIDTH) // Things get no darker past that distance
+#define FOG_DENSITY 0.75               // Share of the light lost at FOG_DISTANCE
 
 #define WW 1280.0 // Window width
 #define WH 720.0  // Window height
@@ -18,4 +20,9 @@
 #define DEG_TO_RAG(x) (x * M_PI / 180)
 #define FOVR DEG_TO_RAG(FOV)
 
+// Columns between two full casts of the walls. Tiles reached within the
+// MAX_RAY_STEPS of a ray stay wider than that on screen, so none can hide
+// between two samples hitting the same face.
+#define WALL_SPAN_STEP 16
+
 #endif
@@ -0,0 +1,50 @@
+#ifndef DOOR_H
+#define DOOR_H
+
+#include "constants.h"
+#include "vector.h"
+#include <stdbool.h>
+
+#define MAX_DOORS 1024 // Doors of the resident chunks, and those left open
+#define DOOR_SPEED 1        // Pixels slid per frame
+#define DOOR_OPEN_DELAY 300 // Frames a door stays fully opened before closing
+#define DOOR_TABLE_SIZE (2 * MAX_DOORS) // Open addressing, at most half full
+
+typedef struct {
+    int col;
+    int row;
+    int open;      // 0: fully closed ; TILE_WIDTH: fully opened
+    int direction; // 1: opening ; -1: closing ; 0: not moving
+    int timer;     // Frames left before an opened door starts to close
+    bool active;   // Registered in the active door list
+} door_t;
+
+// Doors are registered the first time they are looked up. Those closed and
+// still are forgotten with their chunk, the others keep their state.
+typedef struct {
+    door_t doors[MAX_DOORS];
+    int door_number;
+    int door_table[DOOR_TABLE_SIZE]; // Index of each door in doors, hashed on its tile
+    int active_doors[MAX_DOORS];     // Only these doors are animated each frame
+    int active_door_number;
+} door_set_t;
+
+// ------------------------
+// Global variables
+// ------------------------
+
+extern _Thread_local door_set_t* door_set; // Doors of the game running on this thread
+
+// ------------------------
+// Functions
+// ------------------------
+
+void reset_doors();
+door_t* door_at(int col, int row);
+door_t* door_find(int col, int row);
+bool door_is_open(int col, int row);
+void toggle_door(door_t* door);
+void update_doors(vector_t player_pos);
+void forget_doors(int col, int row);
+
+#endif
@@ -0,0 +1,30 @@
+#ifndef GEOMETRY_H
+#define GEOMETRY_H
+
+#include <SDL2/SDL.h>
+#include <SDL2/SDL_render.h>
+#include <stdbool.h>
+
+// Vertex and index buffers of textured quads sharing a single texture,
+// submitted at once with SDL_RenderGeometry. The buffers grow on demand and
+// are kept between frames, so a steady frame does not allocate anything.
+typedef struct {
+    SDL_Texture* texture;
+    float texture_width;
+    float texture_height;
+    SDL_Vertex* vertices;
+    int vertex_number;
+    int vertex_capacity;
+    int* indices;
+    int index_number;
+    int index_capacity;
+    int submissions; // SDL_RenderGeometry calls issued since the last reset
+} geometry_batch_t;
+
+void batch_begin(geometry_batch_t* batch, SDL_Texture* texture, int width, int height);
+void batch_push_quad(geometry_batch_t* batch, const SDL_Rect* src, const SDL_FRect* dst,
+                     SDL_Color color);
+bool batch_flush(SDL_Renderer* renderer, geometry_batch_t* batch);
+void batch_free(geometry_batch_t* batch);
+
+#endif
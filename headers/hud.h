@@ -0,0 +1,21 @@
+#ifndef HUD_H
+#define HUD_H
+
+#include "render.h"
+#include <SDL2/SDL.h>
+#include <SDL2/SDL_ttf.h>
+#include <stdbool.h>
+
+#define HUD_FIRST_GLYPH ' '
+#define HUD_LAST_GLYPH '~'
+#define HUD_TEXT_LENGTH 64 // Longest line of HUD text, terminator included
+
+// ------------------------
+// Functions
+// ------------------------
+
+bool hud_init(TTF_Font* font, SDL_Color color);
+void hud_draw_text(render_backend_t* backend, int x, int y, const char* text);
+void hud_free();
+
+#endif
@@ -0,0 +1,47 @@
+#ifndef INPUT_H
+#define INPUT_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define INPUT_LOG_MAGIC "RCINPUT"
+#define INPUT_LOG_VERSION 1
+#define INPUT_LATENCY_MAX_MS 250   // Latencies above fall in the last bucket
+#define INPUT_LATENCY_PENDING 1024 // Events waiting for their present, more are skipped
+
+// Everything the player did during one frame
+typedef struct {
+    int step_forward; // Sum of the z/s steps
+    int step_side;    // Sum of the q/d steps
+    int mouse_delta;  // Horizontal mouse move, in pixels
+    bool firing;      // Mouse button held
+    bool use_door;    // U pressed
+    bool reload;      // K pressed
+    bool quit;
+} frame_input_t;
+
+// On disk record, only written for frames where something happened
+typedef struct {
+    uint32_t frame;
+    int16_t step_forward;
+    int16_t step_side;
+    int16_t mouse_delta;
+    uint8_t flags;
+    uint8_t padding;
+} input_record_t;
+
+// ------------------------
+// Functions
+// ------------------------
+
+bool input_record_start(const char* path);
+void input_record(long frame, const frame_input_t* input);
+bool input_replay_start(const char* path);
+bool input_replay(long frame, frame_input_t* input);
+bool input_replaying();
+void input_latency_start();
+void input_latency_event(uint32_t timestamp, bool next_frame);
+void input_latency_present(uint32_t now);
+void input_stop();
+
+#endif
@@ -0,0 +1,80 @@
+#ifndef LOS_H
+#define LOS_H
+
+#include "map.h"
+#include "vector.h"
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#define LOS_CACHE_SIZE 4096  // Tile pairs remembered within a frame, a power of two
+#define LOS_MAX_THREADS 8    // Workers walking the segments, the caller aside
+#define LOS_GRAIN 32         // Segments a worker takes at once
+#define LOS_MIN_PARALLEL 256 // Fewer segments to walk are not worth waking the workers
+#define LOS_PEEK_CHUNKS 25   // Chunks a group of walks pages in and peeks at once
+
+/// Words of the bitset answering count queries
+#define LOS_WORDS(count) (((count) + 31) / 32)
+
+// A segment between two points of the world. Lines of sight join the
+// centers of the tiles holding them, so that the answers can be shared by
+// every query between the same two tiles.
+typedef struct {
+    vector_t from;
+    vector_t to;
+} los_query_t;
+
+typedef struct {
+    unsigned long queries;
+    unsigned long walks; // Queries answered by walking the grid, not by the cache
+} los_stats_t;
+
+// Answers of the current frame, by pair of tiles. Entries of older frames
+// are free: nothing is cleared between two frames.
+typedef struct {
+    uint64_t key;
+    unsigned long frame;
+    int walk; // Walk answering the pair, while the batch is in progress
+    bool visible;
+} los_entry_t;
+
+// A pair of tiles whose line of sight has to be walked
+typedef struct {
+    int from_col, from_row;
+    int to_col, to_row;
+    los_entry_t* entry; // Where the answer is cached, if anywhere
+    bool visible;
+} los_walk_t;
+
+// Lines of sight of a game: the answers of its frame, and per batch the
+// walks to do and which walk (or cached answer) each query reads
+typedef struct {
+    los_entry_t cache[LOS_CACHE_SIZE];
+    unsigned long frame;
+    los_walk_t* walks;
+    int* answers;
+    int capacity;
+    int walk_count;
+    int walk_end; // End of the group of walks in progress
+    atomic_int next_walk;
+    los_stats_t stats;
+} los_t;
+
+// ------------------------
+// Global variables
+// ------------------------
+
+extern _Thread_local los_t* los; // Lines of sight of the game running on this thread
+
+// ------------------------
+// Functions
+// ------------------------
+
+void los_start();
+void los_reset();
+void los_new_frame();
+void los_batch(const los_query_t* queries, int count, uint32_t* visible);
+void los_free();
+void los_stop();
+
+#endif
@@ -0,0 +1,221 @@
+#ifndef MAP_H
+#define MAP_H
+
+#include "constants.h"
+#include "vector.h"
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#define CHUNK_SIZE 16       // Tiles on each side of a chunk
+#define CHUNK_CACHE_SIZE 64 // Chunks resident at most
+#define CHUNK_LOADERS 4     // Threads reading the chunks of every world file
+#define WORLD_BOUNDARY 'b'  // Tile seen past the edges of the world
+#define FLOOR_SLOT 6        // Atlas slots of the floors and ceilings left out
+#define CEILING_SLOT 10
+
+// Potentially visible sets: the cells of PVS_CELL² tiles a cell may see, as
+// one bit per cell of the PVS_SPAN² square centered on its own, as far as
+// the rays, and the neighbours of the tiles they cross, reach from it
+#define PVS_CELL 4
+#define PVS_CELLS (CHUNK_SIZE / PVS_CELL) // On each side of a chunk
+#define PVS_RADIUS ((PVS_CELL + MAX_RAY_STEPS) / PVS_CELL)
+#define PVS_SPAN (2 * PVS_RADIUS + 1)
+#define PVS_WORDS ((PVS_SPAN * PVS_SPAN + 31) / 32)
+
+// Chunks paged in around the player's one: as far as the rays, and the
+// neighbours of the tiles they cross, reach from anywhere in it
+#define CHUNK_PREFETCH_RADIUS ((CHUNK_SIZE + MAX_RAY_STEPS) / CHUNK_SIZE)
+#define CHUNK_PREFETCH_SPAN (2 * CHUNK_PREFETCH_RADIUS + 1)
+
+#define WORLD_MAGIC "RCWORLD"
+#define WORLD_VERSION 4 // Version 1 files have no PVS, everything is visible,
+                        // version 2 ones no floors, all get the default slots,
+                        // version 3 ones see whole chunks from every tile
+
+// ----------------------------------------------------------
+// World file: header, then every chunk row by row, each one
+// being CHUNK_SIZE² wall tiles, CHUNK_SIZE² props, the
+// PVS_CELLS² PVS of its cells, then the floor and ceiling
+// atlas slots of its tiles
+// ----------------------------------------------------------
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t width; // In tiles
+    uint32_t height;
+    uint32_t chunk_size;
+} world_header_t;
+
+typedef enum { CHUNK_FREE, CHUNK_LOADING, CHUNK_READY } chunk_state;
+
+typedef struct {
+    char tiles[CHUNK_SIZE][CHUNK_SIZE];
+    char sprites[CHUNK_SIZE][CHUNK_SIZE]; // Props spawned the first time the chunk is ready
+    uint32_t pvs[PVS_CELLS][PVS_CELLS][PVS_WORDS];
+    uint8_t floors[CHUNK_SIZE][CHUNK_SIZE];   // Atlas slot of the floor of every tile
+    uint8_t ceilings[CHUNK_SIZE][CHUNK_SIZE]; // Same for the ceiling above it
+} chunk_data_t;
+
+_Static_assert(CHUNK_SIZE <= 32, "solidity rows are 32-bit masks");
+_Static_assert(CHUNK_SIZE % PVS_CELL == 0, "chunks are cut into whole PVS cells");
+_Static_assert((PVS_CELLS - 1 + PVS_RADIUS) / PVS_CELLS <= CHUNK_PREFETCH_RADIUS,
+               "the PVS square reaches past the prefetched chunks");
+
+// A chunk in the cache. Its solidity is kept as one bit per tile, a mask per
+// row, so the ray traversal and the collisions never compare tile codes.
+typedef struct chunk {
+    int index;        // Chunk number in the world, -1 for a free slot
+    atomic_int state; // Written by a loader thread once the data is in
+    struct world* owner;        // World of the cache, for the loader threads
+    struct chunk* next_request; // Next chunk queued for the loader threads
+    unsigned long last_used;  // Read tick, the least recently read are evicted first
+    unsigned long prefetched; // Last frame it was around the player, kept over the others
+    chunk_data_t data;
+    bool solidity_ready;
+    uint32_t opaque[CHUNK_SIZE];   // Tiles stopping the rays: walls and doors
+    uint32_t solid[CHUNK_SIZE];    // Walls, and doors that are not fully opened
+    uint32_t occupied[CHUNK_SIZE]; // Tiles holding a live prop with collision
+    short cell_props[PVS_CELLS][PVS_CELLS]; // First prop standing in every PVS cell, -1 if none
+} chunk_t;
+
+// A level: the text maps compiled into chunks in memory, or a world file.
+// Never written once open, so every world playing it shares it.
+typedef struct {
+    int width; // In tiles
+    int height;
+    int chunk_cols;
+    int chunk_rows;
+    uint32_t version;
+    chunk_data_t* chunks; // Compiled in memory, NULL for a world file
+    int fd;               // World file, read with pread from any thread
+} level_t;
+
+// A game playing a level: the chunks resident around its player, and what
+// became of their props and doors
+typedef struct world {
+    int width; // In tiles
+    int height;
+    int chunk_cols;
+    int chunk_rows;
+    unsigned long clock;  // Frames seen
+    unsigned long ticks;  // Chunk reads, orders the cache for the evictions
+    unsigned long stalls; // Tiles read before their chunk was paged in
+    unsigned long loads;
+    unsigned long revision; // New whenever the walls look different (a door moving)
+    unsigned long spawns;   // New whenever props join or leave the game with their chunk
+
+    const level_t* level;
+    // Resident chunks. A slot being loaded is never evicted, so the loader
+    // threads can fill it without holding the lock.
+    chunk_t cache[CHUNK_CACHE_SIZE];
+    short* directory;    // Cache slot of every chunk, -1 if not resident
+    bool* spawned;       // Chunks whose props already joined the game
+    short* prop_links;   // Next prop of the same PVS cell, -1 after the last
+    bool despawn_due;    // A chunk in spawned was evicted since the last spawn
+    chunk_t* last_chunk; // Consecutive reads mostly hit the same chunk
+
+    pthread_mutex_t lock;
+    pthread_cond_t loaded; // A chunk became ready
+    bool streamed;         // Chunks are read by the loader threads
+} world_t;
+
+// ------------------------
+// Global variables
+// ------------------------
+
+extern _Thread_local world_t* world; // World of the game running on this thread
+
+// ------------------------
+// Functions
+// ------------------------
+
+level_t* level_open(const char* path);
+level_t* level_open_text(const char* map_path, const char* sprite_path,
+                         const char* floor_path, const char* ceiling_path);
+bool level_write(const level_t* level, const char* path);
+void level_close(level_t* level);
+bool world_open(const level_t* level);
+void world_follow(vector_t pos);
+void world_prefetch(vector_t pos);
+void world_sync();
+void world_close();
+void world_stop_loaders();
+chunk_t* world_chunk(int col, int row);
+const chunk_data_t* world_resident_chunk(int col, int row);
+void world_update_tile(int col, int row);
+void world_reset_solidity();
+void world_revise();
+void world_prepare_peek(int min_col, int min_row, int max_col, int max_row);
+bool world_peek_solid(int col, int row);
+int world_visible_props(int col, int row, int* props);
+
+/// Tile at the given position, WORLD_BOUNDARY outside of the world. Game
+/// thread only.
+static inline char world_tile(int col, int row) {
+    if (col < 0 || col >= world->width || row < 0 || row >= world->height) {
+        return WORLD_BOUNDARY;
+    }
+    return world_chunk(col, row)->data.tiles[row % CHUNK_SIZE][col % CHUNK_SIZE];
+}
+
+static inline bool chunk_bit(const uint32_t* plane, int col, int row) {
+    return (plane[row % CHUNK_SIZE] >> (col % CHUNK_SIZE)) & 1;
+}
+
+/// True if rays stop (or have to test a door) on that tile
+static inline bool world_opaque(int col, int row) {
+    if (col < 0 || col >= world->width || row < 0 || row >= world->height) {
+        return true;
+    }
+    return chunk_bit(world_chunk(col, row)->opaque, col, row);
+}
+
+/// True if enemies cannot walk on that tile (props aside)
+static inline bool world_solid(int col, int row) {
+    if (col < 0 || col >= world->width || row < 0 || row >= world->height) {
+        return true;
+    }
+    return chunk_bit(world_chunk(col, row)->solid, col, row);
+}
+
+/// True if the player cannot walk on that tile: solid, or a live prop with
+/// collision stands there
+static inline bool world_blocked(int col, int row) {
+    if (col < 0 || col >= world->width || row < 0 || row >= world->height) {
+        return true;
+    }
+    chunk_t* chunk = world_chunk(col, row);
+    return chunk_bit(chunk->solid, col, row) || chunk_bit(chunk->occupied, col, row);
+}
+
+/// True if a live prop with collision stands on that tile
+static inline bool world_occupied(int col, int row) {
+    if (col < 0 || col >= world->width || row < 0 || row >= world->height) {
+        return false;
+    }
+    return chunk_bit(world_chunk(col, row)->occupied, col, row);
+}
+
+/// False if no line of sight can join the two tiles, doors being open.
+/// Conservative: tiles outside of the world are always visible.
+static inline bool world_visible(int from_col, int from_row, int to_col, int to_row) {
+    if (from_col < 0 || from_col >= world->width || from_row < 0 || from_row >= world->height ||
+        to_col < 0 || to_col >= world->width || to_row < 0 || to_row >= world->height) {
+        return true;
+    }
+    int _dx = to_col / PVS_CELL - from_col / PVS_CELL + PVS_RADIUS;
+    int _dy = to_row / PVS_CELL - from_row / PVS_CELL + PVS_RADIUS;
+    if (_dx < 0 || _dx >= PVS_SPAN || _dy < 0 || _dy >= PVS_SPAN) {
+        return false;
+    }
+    const chunk_t* chunk = world_chunk(from_col, from_row);
+    const uint32_t* _pvs =
+        chunk->data.pvs[from_row % CHUNK_SIZE / PVS_CELL][from_col % CHUNK_SIZE / PVS_CELL];
+    int _bit = _dy * PVS_SPAN + _dx;
+    return (_pvs[_bit / 32] >> (_bit % 32)) & 1;
+}
+
+#endif
@@ -0,0 +1,35 @@
+#ifndef OPTIONS_H
+#define OPTIONS_H
+
+#include <stdbool.h>
+
+typedef enum {
+    BACKEND_SDL,      // One SDL_RenderCopy per wall and sprite column
+    BACKEND_GEOMETRY, // One SDL_RenderGeometry call per texture and frame
+    BACKEND_SOFTWARE, // CPU framebuffer shown through the window surface
+    BACKEND_MEMORY,   // CPU framebuffer only, no window nor SDL video
+} render_backend_type;
+
+typedef struct {
+    const char* asset_root;    // Directory holding the images and the font
+    const char* bundle_path;   // Prebuilt asset bundle to map instead of decoding
+    const char* bundle_output; // If set, write the asset bundle there and exit
+    int asset_workers;         // Decoding threads, 0 for one per CPU
+    render_backend_type backend;
+    bool software_renderer;   // Ask SDL for its software renderer
+    long max_frames;          // Quit after that many frames, 0 to run until asked
+    bool uncapped;            // Do not wait to hold 60 frames per second
+    const char* capture_path; // Record the frames to this .y4m or .ppm file
+    const char* record_path;  // Log the player input to this file
+    const char* replay_path;  // Play the input logged in this file
+    bool latency;             // Measure the input to present latency
+    const char* world_path;   // Chunked world to stream instead of the text maps
+    const char* world_output; // If set, write the text maps as a world there and exit
+} options_t;
+
+extern options_t options;
+
+bool parse_options(int argc, char** argv);
+void print_usage(const char* program);
+
+#endif
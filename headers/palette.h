@@ -0,0 +1,47 @@
+#ifndef PALETTE_H
+#define PALETTE_H
+
+#include "constants.h"
+#include <SDL2/SDL.h>
+#include <stdbool.h>
+
+#define PALETTE_SIZE 256
+#define PALETTE_TRANSPARENT 0 // Index of every texel with alpha below 0x80
+#define COLORMAP_LEVELS 32    // Distance fog steps, from 0 to FOG_DISTANCE
+
+// ------------------------
+// Global variables
+// ------------------------
+
+extern Uint32 palette[PALETTE_SIZE];
+
+// Palette already expanded to ARGB8888 for every fog level, lit and shaded:
+// a lit texel costs one lookup, whatever its distance and side
+extern Uint32 colormaps[2][COLORMAP_LEVELS][PALETTE_SIZE];
+
+// ------------------------
+// Functions
+// ------------------------
+
+bool build_palette();
+
+/// Fog level of something seen at the given orthogonal distance
+static inline int colormap_level(double distance) {
+    if (!(distance < FOG_DISTANCE)) {
+        return COLORMAP_LEVELS - 1; // Also catches the infinite horizon
+    }
+    return distance <= 0 ? 0 : (int)(distance * (COLORMAP_LEVELS - 1) / FOG_DISTANCE);
+}
+
+/// Brightness (0 to 255) applied by the colormap of that level, for the
+/// backends modulating a true color texture instead
+static inline Uint8 colormap_intensity(int level, bool shaded) {
+    double _light = 1 - FOG_DENSITY * level / (COLORMAP_LEVELS - 1);
+    return (Uint8)(0xff * _light / (shaded ? 2 : 1));
+}
+
+static inline const Uint32* get_colormap(double distance, bool shaded) {
+    return colormaps[shaded][colormap_level(distance)];
+}
+
+#endif
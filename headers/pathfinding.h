@@ -0,0 +1,73 @@
+#ifndef PATHFINDING_H
+#define PATHFINDING_H
+
+#include "constants.h"
+#include "vector.h"
+#include <stdbool.h>
+
+#define FLOW_UNREACHABLE -1
+#define FLOW_FIELD_SIZE 32 // Tiles covered on each side, centered on the target
+#define FLOW_TILES (FLOW_FIELD_SIZE * FLOW_FIELD_SIZE)
+#define FLOW_OCCUPIED_COST 4 // Extra cost of a tile where a prop stands
+#define FLOW_MAX_CHANGES 64  // Changed tiles repaired one by one, more rebuild the field
+
+// Direction to follow from a tile to get one step closer to the target
+typedef struct {
+    signed char dx;
+    signed char dy;
+} flow_dir_t;
+
+// Flow field computed from the player's tile: the cheapest path to it from
+// every tile of the window, entering a tile costing 1, FLOW_OCCUPIED_COST more
+// if a prop stands there, so enemies spread around each other rather than
+// queue up on the shortest path. Every enemy reads the direction of its own
+// tile, so the cost of a rebuild is O(window) whatever the number of enemies
+// and the size of the world. Once built, a tile changing (a door, an enemy
+// moving) only repairs the tiles whose path went through it.
+// Enemies outside of the window stay still.
+typedef struct {
+    int distance[FLOW_FIELD_SIZE][FLOW_FIELD_SIZE]; // Cost of the path to the target
+    flow_dir_t dir[FLOW_FIELD_SIZE][FLOW_FIELD_SIZE];
+    int origin_col; // World tile of the top-left corner of the window
+    int origin_row;
+    int target_col;
+    int target_row;
+    bool dirty;           // Forces a rebuild even if the target did not move
+    unsigned long spawns; // world->spawns when built: props coming or going change the costs
+
+    int changes[FLOW_MAX_CHANGES]; // Window positions changed since the last update
+    int change_number;
+
+    // Marks of the current rebuild or repair, each tile being listed once
+    unsigned int stamp;
+    unsigned int affected_mark[FLOW_FIELD_SIZE][FLOW_FIELD_SIZE];
+    unsigned int touched_mark[FLOW_FIELD_SIZE][FLOW_FIELD_SIZE];
+    int affected[FLOW_TILES]; // Tiles whose path went through a changed one
+    int affected_number;
+    int touched[FLOW_TILES]; // Tiles whose distance changed
+    int touched_number;
+
+    // Dijkstra's queue of cost * FLOW_TILES + position: a tile is pushed
+    // when seeded and when a neighbour improves it, from its 4 neighbours
+    // settled once each
+    int heap[5 * FLOW_TILES];
+    int heap_size;
+} flow_field_t;
+
+// ------------------------
+// Global variables
+// ------------------------
+
+extern _Thread_local flow_field_t* flow_field; // Field of the game running on this thread
+
+// ------------------------
+// Functions
+// ------------------------
+
+bool is_walkable(int col, int row);
+void flow_field_reset();
+void flow_field_tile_changed(int col, int row);
+bool flow_field_update(vector_t target);
+vector_t flow_field_step(vector_t pos, double step);
+
+#endif
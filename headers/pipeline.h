@@ -0,0 +1,36 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include "input.h"
+#include "raycaster.h"
+#include "render.h"
+#include <stdbool.h>
+
+// ----------------------------------------------------------
+// Two stage pipeline: a simulation thread steps the game to frame N+1
+// while the caller draws frame N. The state of each frame is handed over
+// as a snapshot, through two buffers used in turn.
+// ----------------------------------------------------------
+
+// ------------------------
+// Functions
+// ------------------------
+
+/// Loads the level into a simulated and a drawn instance, publishes the
+/// first frame and starts the simulation thread
+bool pipeline_start(const char* world_path);
+
+/// Hands the input of the frame about to be drawn to the simulation, which
+/// steps to the next frame while this one is drawn
+void pipeline_submit(const frame_input_t* input);
+
+/// Waits for the state of the frame about to be drawn and returns the
+/// instance holding it, NULL if the simulation failed. Only blocks while the
+/// simulation of that frame runs late: no frame is skipped nor drawn twice.
+raycaster_t* pipeline_acquire();
+
+/// Waits for the frame being simulated, stops the thread, prints the
+/// statistics of both stages if backend is set and frees the instances
+void pipeline_stop(const render_backend_t* backend);
+
+#endif
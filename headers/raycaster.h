@@ -0,0 +1,125 @@
+#ifndef RAYCASTER_H
+#define RAYCASTER_H
+
+#include "input.h"
+#include "render.h"
+#include "vector.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// ----------------------------------------------------------
+// Raycaster core: assets, world, simulation and rendering,
+// without any window, event loop nor SDL video. The game is
+// a front-end over it; a headless program only needs this.
+// Any number of instances run side by side, sharing the
+// assets and the levels.
+// ----------------------------------------------------------
+
+#define RAYCASTER_WIDTH ((int)WW) // Size of the frames rendered, in pixels
+#define RAYCASTER_HEIGHT ((int)WH)
+#define RAYCASTER_MAX_THREADS 64 // Workers of the lockstep calls, the caller aside
+
+#define SNAPSHOT_MAGIC "RCSNAP"
+#define SNAPSHOT_VERSION 3
+
+// A game: its player, world, props, doors and frame. Each instance is used
+// by one thread at a time, any thread.
+typedef struct raycaster raycaster_t;
+
+// Face of a tile, named after the side of the tile it lies on
+typedef enum { FACE_WEST, FACE_EAST, FACE_NORTH, FACE_SOUTH } raycaster_face;
+
+// What the wall ray of a screen column hit
+typedef struct {
+    int32_t col;    // Tile hit
+    int32_t row;
+    char tile;      // Its code in the map
+    bool door;      // On the closed part of a door, not on its frame
+    uint8_t face;   // raycaster_face
+    float u;        // Texture coordinate across the face, from 0 to 1
+    float distance; // Orthogonal distance to the camera
+} raycaster_hit_t;
+
+// Optional outputs of a frame, filled while drawing it, each one NULL if not
+// wanted. The per pixel ones are RAYCASTER_WIDTH x RAYCASTER_HEIGHT, row by
+// row, and only written by the CPU backends.
+typedef struct {
+    float* depth;          // Distance to the camera of every pixel, gun aside
+    int32_t* entities;     // Index of the prop drawn on every pixel, -1 elsewhere
+    raycaster_hit_t* hits; // RAYCASTER_WIDTH columns
+} raycaster_outputs_t;
+
+// ------------------------
+// Functions
+// ------------------------
+
+/// Loads the assets, from a bundle if bundle_path is set, else by decoding
+/// the images found in asset_root with that many workers (0: one per CPU).
+/// Once per process, before any instance.
+bool raycaster_init(const char* asset_root, const char* bundle_path, int asset_workers);
+
+raycaster_t* raycaster_create();
+
+/// Streams the given world file, or the text maps if world_path is NULL.
+/// Props, doors and the player start over. A level is compiled or opened
+/// once, then shared by every instance playing it.
+bool raycaster_load_level(raycaster_t* rc, const char* world_path);
+
+void raycaster_set_camera(raycaster_t* rc, vector_t pos, vector_t dir);
+player_t raycaster_camera(const raycaster_t* rc);
+int raycaster_ammo(const raycaster_t* rc);
+
+/// Bytes of a snapshot of the instance, which depends on its level
+size_t raycaster_snapshot_size(const raycaster_t* rc);
+
+/// Copies the state of the game (player, gun, props, doors and the chunks
+/// whose props were spawned) into blob, at least raycaster_snapshot_size
+/// bytes. The blob is flat: it may be copied, kept or written as is.
+bool raycaster_save(const raycaster_t* rc, void* blob, size_t size);
+
+/// Puts the game back in the state of a snapshot taken on the same level,
+/// by this instance or another one, and pages in the chunks around its
+/// camera. Restoring a snapshot of the next frame only costs the tiles that
+/// changed in between.
+bool raycaster_restore(raycaster_t* rc, const void* blob, size_t size);
+
+/// Turns and moves the camera as that input would, without running the rest
+/// of the frame: an instance about to be drawn follows the latest input
+/// before the simulation is done with it
+void raycaster_move(raycaster_t* rc, const frame_input_t* input);
+
+/// Runs one frame of the game for that input: shots, doors, moves and
+/// enemies. False if the frame arena is too small.
+bool raycaster_step(raycaster_t* rc, const frame_input_t* input);
+
+/// Draws the frame (walls, floor, ceiling, sprites and gun) through a
+/// backend, without presenting it, and fills the outputs if not NULL. False
+/// if the frame arena is too small.
+bool raycaster_draw(raycaster_t* rc, render_backend_t* backend,
+                    const raycaster_outputs_t* outputs);
+
+/// Renders the frame into RAYCASTER_WIDTH x RAYCASTER_HEIGHT pixels of 4
+/// bytes, red, green, blue then alpha, rows being pitch bytes apart
+bool raycaster_render(raycaster_t* rc, uint8_t* rgba, int pitch,
+                      const raycaster_outputs_t* outputs);
+
+/// Steps count instances in lockstep, each one with its own input, across
+/// a pool of workers. Returns once all of them are done, false if any
+/// step failed. Calls from other threads meanwhile run on their caller
+/// alone, an instance being used by one of them at a time.
+bool raycaster_step_all(raycaster_t** rcs, const frame_input_t* inputs, int count);
+
+/// Renders count instances in lockstep, instance i into rgba[i] and
+/// outputs[i] (outputs may be NULL)
+bool raycaster_render_all(raycaster_t** rcs, uint8_t** rgba, int pitch,
+                          const raycaster_outputs_t* outputs, int count);
+
+void raycaster_print_stats(const raycaster_t* rc, const render_backend_t* backend);
+void raycaster_destroy(raycaster_t* rc);
+
+/// Stops the workers and frees the levels and the assets, once every
+/// instance is destroyed
+void raycaster_quit();
+
+#endif
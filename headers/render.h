@@ -0,0 +1,73 @@
+#ifndef RENDER_H
+#define RENDER_H
+
+#include "assets.h"
+#include "constants.h"
+#include "palette.h"
+#include <SDL2/SDL.h>
+#include <SDL2/SDL_render.h>
+#include <SDL2/SDL_surface.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+// A column of texels stretched over one screen column
+typedef struct {
+    int x;           // Screen column
+    double top;      // Screen row of the first texel, may be off screen
+    double height;   // Height of the column on screen
+    asset_id asset;
+    SDL_Rect src;    // Texels to sample, one texel wide
+    bool shaded;     // Halve the brightness (walls hit on a horizontal face)
+    double distance; // Orthogonal distance to the camera, picks the fog level
+    int entity;      // Index of the prop drawn in props, -1 for the walls
+} column_span_t;
+
+typedef struct render_backend render_backend_t;
+
+// Everything the game needs to put a frame on screen (or in memory). Each
+// implementation embeds this structure as its first member.
+struct render_backend {
+    const char* name;
+    SDL_Window* window;  // NULL when rendering without a display
+    Uint32* framebuffer; // Finished ARGB8888 frame for CPU backends, else NULL
+    Uint64 submissions;  // Draw calls handed to SDL
+
+    // Optional WW x WH outputs, written by the CPU backends along with the
+    // pixels of the spans when set: their distance, and their entity
+    float* depth;
+    int32_t* entities;
+
+    /// Starts a frame and returns the WW x WH buffer to cast the floor and
+    /// ceiling into
+    Uint32* (*begin_frame)(render_backend_t* self);
+    void (*draw_column)(render_backend_t* self, const column_span_t* span);
+    /// Same as draw_column, only the opaque runs of the texture column are
+    /// drawn, without blending
+    void (*draw_sprite_span)(render_backend_t* self, const column_span_t* span);
+    /// Copies an ARGB8888 surface over the frame. Surfaces other than assets
+    /// may be cached: they must not change while they are being blitted.
+    void (*blit_hud)(render_backend_t* self, SDL_Surface* surface, const SDL_Rect* src,
+                     const SDL_Rect* dst);
+    /// Keeps the frame drawn so far (floor, ceiling and walls) for
+    /// restore_scene. Both are NULL if the backend cannot keep a scene.
+    void (*save_scene)(render_backend_t* self);
+    /// Starts a frame from the scene kept by save_scene, instead of
+    /// begin_frame and the walls. False if none has been kept yet.
+    bool (*restore_scene)(render_backend_t* self);
+    /// Copies the frame drawn so far as WW x WH ARGB8888 pixels
+    bool (*read_pixels)(render_backend_t* self, Uint32* pixels);
+    void (*present)(render_backend_t* self);
+    void (*destroy)(render_backend_t* self);
+};
+
+// ------------------------
+// Implementations
+// ------------------------
+
+// Front-end only, they open a window
+render_backend_t* create_sdl_backend(bool batched, bool software_renderer);
+render_backend_t* create_software_backend();
+// In raycaster_core
+render_backend_t* create_memory_backend();
+
+#endif
@@ -1,10 +1,15 @@
 #ifndef SPRITE_H
 #define SPRITE_H
 
+#include "assets.h"
 #include "constants.h"
+#include "map.h"
 #include "vector.h"
 #include <stdbool.h>
 
+#define MAX_PROPS 1024 // Props and enemies of the resident chunks, and those that changed
+#define MAX_ENEMIES MAX_PROPS
+
 typedef enum {
     EMPTY,
     WOODEN_BARREL,
@@ -17,11 +22,13 @@ typedef enum {
     SOLDIER
 } sprite_type;
 
-typedef enum { PROP_IDLE = 0, PROP_DEAD } prop_state;
+// Enemies stay idle until they have seen the player (or have been shot),
+// then keep on chasing
+typedef enum { PROP_IDLE = 0, PROP_DEAD, PROP_CHASING } prop_state;
 
 // TODO: Add a field to indicate if this sprite has collision
 typedef struct {
-    char* path;
+    asset_id asset;
     int width;
     int height;
     bool collision;
@@ -35,22 +42,31 @@ typedef struct {
     vector_t position;
     prop_state state;
     int life;
+    int origin_col; // Tile it was spawned on
+    int origin_row;
 } prop_t;
 
 // Structure used to sort props to render by distance
 typedef struct {
     prop_t prop;
     double distance;
+    int index; // In props
 } real_world_prop_t;
 
+// Props and enemies spawned in a game. Idle ones are as spawned, they are
+// dropped with their chunk and spawned again with it.
+typedef struct {
+    prop_t props[MAX_PROPS];
+    int enemy_index[MAX_ENEMIES]; // Enemies' indices in props, -1 past the last one
+    int prop_number;
+    int enemy_number;
+} prop_set_t;
+
 // ------------------------
 // Global variables
 // ------------------------
 
-/// The list of enemies' indices in the props array
-extern int enemy_index[100];
-extern prop_t props[MAP_HEIGHT * MAP_WIDTH];
-extern int prop_number;
+extern _Thread_local prop_set_t* prop_set; // Props of the game running on this thread
 
 extern const sprite_t wooden_barrel_sprite;
 extern const sprite_t iron_barrel_sprite;
@@ -65,10 +81,14 @@ extern const sprite_t empty_sprite;
 // Functions
 // ------------------------
 
-void load_sprite_map(const char* path);
+void reset_props();
+void spawn_props(int col, int row, const chunk_data_t* chunk);
+void despawn_props(int col, int row);
 sprite_t get_sprite(sprite_type type);
 int compare_props(const void* a, const void* b);
 prop_t* sprite_at_pos(int x, int y);
+bool prop_collides(const prop_t* prop);
+bool prop_blocks(int col, int row);
 bool is_enemy(sprite_type t);
 
 #endif
@@ -0,0 +1,40 @@
+#include "arena.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+/// Reserves the whole capacity up front: the arena never grows, so its
+/// footprint is known from the start
+bool arena_init(arena_t* arena, size_t capacity) {
+    *arena = (arena_t){0};
+    arena->base = aligned_alloc(ARENA_ALIGNMENT,
+                                (capacity + ARENA_ALIGNMENT - 1) & ~(size_t)(ARENA_ALIGNMENT - 1));
+    if (arena->base == NULL) {
+        fprintf(stderr, "Error at arena allocation: %zu bytes\n", capacity);
+        return false;
+    }
+    arena->capacity = capacity;
+    return true;
+}
+
+/// Returns size bytes aligned on ARENA_ALIGNMENT, or NULL (counted as a
+/// failure) when the arena is exhausted
+void* arena_alloc(arena_t* arena, size_t size) {
+    size_t _start = (arena->used + ARENA_ALIGNMENT - 1) & ~(size_t)(ARENA_ALIGNMENT - 1);
+    if (_start > arena->capacity || size > arena->capacity - _start) {
+        arena->failures++;
+        return NULL;
+    }
+    arena->used = _start + size;
+    if (arena->used > arena->high_water) {
+        arena->high_water = arena->used;
+    }
+    return arena->base + _start;
+}
+
+/// Releases every allocation, the memory is kept for the next round
+void arena_reset(arena_t* arena) { arena->used = 0; }
+
+void arena_free(arena_t* arena) {
+    free(arena->base);
+    *arena = (arena_t){0};
+}
@@ -0,0 +1,350 @@
+#include "assets.h"
+#include <SDL2/SDL_image.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define BUNDLE_ALIGNMENT 64
+
+asset_t assets[ASSET_COUNT] = {
+    [ASSET_WALLS] = {"wolftextures.png", ASSET_IMAGE},
+    [ASSET_GUN] = {"minigun.png", ASSET_IMAGE},
+    [ASSET_WOODEN_BARREL] = {"wooden_barrel.png", ASSET_IMAGE},
+    [ASSET_IRON_BARREL] = {"iron_barrel.png", ASSET_IMAGE},
+    [ASSET_DINNER_TABLE] = {"dinner_table.png", ASSET_IMAGE},
+    [ASSET_FURNACE] = {"furnace.png", ASSET_IMAGE},
+    [ASSET_ARMOR] = {"armor.png", ASSET_IMAGE},
+    [ASSET_WELLWATER] = {"well.png", ASSET_IMAGE},
+    [ASSET_PILLAR] = {"pillar.png", ASSET_IMAGE},
+    [ASSET_SOLDIER] = {"guard.png", ASSET_IMAGE},
+    [ASSET_FONT] = {"Monocraft-nerd-fonts-patched.ttf", ASSET_BLOB},
+};
+
+// Bundle mapping, kept alive as long as the assets point into it
+static void* bundle_data = NULL;
+static size_t bundle_size = 0;
+static bool image_loader_ready = false; // IMG_Init succeeded, IMG_Quit is due
+
+// -------------------------
+// Parallel decoding
+// -------------------------
+
+typedef struct {
+    const char* root;
+    atomic_int next; // Next asset to be decoded by any worker
+    atomic_bool failed;
+} decode_job_t;
+
+static bool read_file(const char* path, void** data, size_t* size) {
+    FILE* file = fopen(path, "rb");
+    if (file == NULL) {
+        return false;
+    }
+    fseek(file, 0, SEEK_END);
+    long _size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+
+    *data = malloc(_size);
+    if (*data == NULL || fread(*data, 1, _size, file) != (size_t)_size) {
+        free(*data);
+        *data = NULL;
+        fclose(file);
+        return false;
+    }
+    *size = _size;
+    fclose(file);
+    return true;
+}
+
+static bool decode_asset(asset_t* asset, const char* root) {
+    char path[512];
+    snprintf(path, sizeof(path), "%s/%s", root, asset->name);
+
+    if (asset->kind == ASSET_BLOB) {
+        if (!read_file(path, &asset->data, &asset->size)) {
+            fprintf(stderr, "Error at asset loading: cannot read %s\n", path);
+            return false;
+        }
+        return true;
+    }
+
+    SDL_Surface* _raw = IMG_Load(path);
+    if (_raw == NULL) {
+        fprintf(stderr, "Error on IMG_Load: %s\n", IMG_GetError());
+        return false;
+    }
+    // Every image is stored with the same layout so that the renderers and
+    // the bundle never have to deal with per-asset pixel formats
+    asset->surface = SDL_ConvertSurfaceFormat(_raw, SDL_PIXELFORMAT_ARGB8888, 0);
+    SDL_FreeSurface(_raw);
+    if (asset->surface == NULL) {
+        fprintf(stderr, "Error on SDL_ConvertSurfaceFormat: %s\n", SDL_GetError());
+        return false;
+    }
+    return true;
+}
+
+static void* decode_worker(void* arg) {
+    decode_job_t* job = arg;
+    int i;
+    while ((i = atomic_fetch_add(&job->next, 1)) < ASSET_COUNT) {
+        if (!decode_asset(&assets[i], job->root)) {
+            atomic_store(&job->failed, true);
+        }
+    }
+    return NULL;
+}
+
+/// Decodes every asset of the table from the root directory, spreading
+/// the work over a pool of workers (0 picks one per online CPU)
+bool load_assets(const char* root, int workers) {
+    if (workers <= 0) {
+        workers = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    }
+    if (workers > ASSET_COUNT) {
+        workers = ASSET_COUNT;
+    }
+    if (workers < 1) {
+        workers = 1;
+    }
+
+    // SDL_image would otherwise set its PNG loader up lazily, from whichever
+    // workers get there first, which is not thread safe
+    if ((IMG_Init(IMG_INIT_PNG) & IMG_INIT_PNG) == 0) {
+        fprintf(stderr, "Error on IMG_Init: %s\n", IMG_GetError());
+        return false;
+    }
+    image_loader_ready = true;
+
+    decode_job_t job = {root};
+    atomic_init(&job.next, 0);
+    atomic_init(&job.failed, false);
+
+    pthread_t threads[ASSET_COUNT];
+    int _started = 0;
+    // The calling thread takes its share of the work too
+    for (int i = 1; i < workers; i++) {
+        if (pthread_create(&threads[_started], NULL, decode_worker, &job) == 0) {
+            _started++;
+        }
+    }
+    decode_worker(&job);
+    for (int i = 0; i < _started; i++) {
+        pthread_join(threads[i], NULL);
+    }
+
+    return !atomic_load(&job.failed);
+}
+
+// -------------------------
+// Bundle
+// -------------------------
+
+static size_t align_offset(size_t offset) {
+    return (offset + BUNDLE_ALIGNMENT - 1) / BUNDLE_ALIGNMENT * BUNDLE_ALIGNMENT;
+}
+
+/// Whether the entry lies within the mapping and, for an image, whether its
+/// rows do within the entry
+static bool valid_entry(const asset_bundle_entry_t* entry) {
+    if (entry->offset > bundle_size || entry->size > bundle_size - entry->offset) {
+        return false;
+    }
+    if (entry->kind != ASSET_IMAGE) {
+        return true;
+    }
+    return entry->width > 0 && entry->height > 0 && entry->width <= INT32_MAX / sizeof(Uint32) &&
+           entry->height <= INT32_MAX && entry->pitch >= entry->width * sizeof(Uint32) &&
+           entry->pitch % sizeof(Uint32) == 0 &&
+           (uint64_t)entry->pitch * entry->height <= entry->size;
+}
+
+/// Maps a bundle written by write_asset_bundle. The pixels are used in place:
+/// nothing is decoded nor copied.
+bool load_asset_bundle(const char* path) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        fprintf(stderr, "Error at bundle loading: cannot open %s\n", path);
+        return false;
+    }
+    struct stat _stat;
+    if (fstat(fd, &_stat) < 0 || (size_t)_stat.st_size < sizeof(asset_bundle_header_t)) {
+        fprintf(stderr, "Error at bundle loading: %s is not a bundle\n", path);
+        close(fd);
+        return false;
+    }
+    bundle_size = _stat.st_size;
+    // Private writable mapping: SDL surfaces expect mutable pixels, copy on
+    // write keeps the file untouched
+    bundle_data = mmap(NULL, bundle_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (bundle_data == MAP_FAILED) {
+        bundle_data = NULL;
+        fprintf(stderr, "Error at bundle loading: cannot map %s\n", path);
+        return false;
+    }
+
+    asset_bundle_header_t* header = bundle_data;
+    if (memcmp(header->magic, ASSET_BUNDLE_MAGIC, sizeof(header->magic)) != 0 ||
+        header->version != ASSET_BUNDLE_VERSION ||
+        sizeof(*header) + header->count * sizeof(asset_bundle_entry_t) > bundle_size) {
+        fprintf(stderr, "Error at bundle loading: bad header in %s\n", path);
+        return false;
+    }
+
+    asset_bundle_entry_t* entries = (asset_bundle_entry_t*)(header + 1);
+    for (int i = 0; i < ASSET_COUNT; i++) {
+        asset_t* asset = &assets[i];
+        asset_bundle_entry_t* entry = NULL;
+
+        for (uint32_t e = 0; e < header->count; e++) {
+            if (strncmp(entries[e].name, asset->name, ASSET_NAME_LENGTH) == 0) {
+                entry = &entries[e];
+                break;
+            }
+        }
+        if (entry == NULL || entry->kind != (uint32_t)asset->kind) {
+            fprintf(stderr, "Error at bundle loading: %s missing from %s\n", asset->name, path);
+            return false;
+        }
+        // A truncated or corrupt bundle must not send the renderers past the
+        // end of the mapping
+        if (!valid_entry(entry)) {
+            fprintf(stderr, "Error at bundle loading: bad entry for %s in %s\n", asset->name,
+                    path);
+            return false;
+        }
+
+        void* payload = (char*)bundle_data + entry->offset;
+        if (asset->kind == ASSET_IMAGE) {
+            asset->surface = SDL_CreateRGBSurfaceWithFormatFrom(
+                payload, entry->width, entry->height, 32, entry->pitch, SDL_PIXELFORMAT_ARGB8888);
+            if (asset->surface == NULL) {
+                fprintf(stderr, "Error on SDL_CreateRGBSurfaceWithFormatFrom: %s\n",
+                        SDL_GetError());
+                return false;
+            }
+        } else {
+            asset->data = payload;
+            asset->size = entry->size;
+        }
+        asset->mapped = true;
+    }
+    return true;
+}
+
+/// Writes the currently loaded assets as a bundle of predecoded pixels
+bool write_asset_bundle(const char* path) {
+    FILE* file = fopen(path, "wb");
+    if (file == NULL) {
+        fprintf(stderr, "Error at bundle writing: cannot open %s\n", path);
+        return false;
+    }
+
+    asset_bundle_header_t header = {{0}, ASSET_BUNDLE_VERSION, ASSET_COUNT};
+    memcpy(header.magic, ASSET_BUNDLE_MAGIC, sizeof(header.magic));
+    asset_bundle_entry_t entries[ASSET_COUNT];
+    memset(entries, 0, sizeof(entries));
+
+    size_t offset = align_offset(sizeof(header) + sizeof(entries));
+    for (int i = 0; i < ASSET_COUNT; i++) {
+        asset_t* asset = &assets[i];
+        asset_bundle_entry_t* entry = &entries[i];
+
+        strncpy(entry->name, asset->name, ASSET_NAME_LENGTH - 1);
+        entry->kind = asset->kind;
+        if (asset->kind == ASSET_IMAGE) {
+            entry->width = asset->surface->w;
+            entry->height = asset->surface->h;
+            entry->pitch = asset->surface->w * sizeof(Uint32);
+            entry->size = (uint64_t)entry->pitch * entry->height;
+        } else {
+            entry->size = asset->size;
+        }
+        entry->offset = offset;
+        offset = align_offset(offset + entry->size);
+    }
+
+    bool ok = fwrite(&header, sizeof(header), 1, file) == 1 &&
+              fwrite(entries, sizeof(entries), 1, file) == 1;
+
+    static const char padding[BUNDLE_ALIGNMENT];
+    for (int i = 0; i < ASSET_COUNT && ok; i++) {
+        asset_t* asset = &assets[i];
+        long _pad = entries[i].offset - ftell(file);
+        ok = fwrite(padding, 1, _pad, file) == (size_t)_pad;
+
+        if (asset->kind == ASSET_IMAGE) {
+            // Rows are written tightly packed, whatever the surface pitch
+            SDL_LockSurface(asset->surface);
+            for (uint32_t y = 0; y < entries[i].height && ok; y++) {
+                const char* row = (const char*)asset->surface->pixels + y * asset->surface->pitch;
+                ok = fwrite(row, entries[i].pitch, 1, file) == 1;
+            }
+            SDL_UnlockSurface(asset->surface);
+        } else if (asset->size > 0) {
+            ok = ok && fwrite(asset->data, asset->size, 1, file) == 1;
+        }
+    }
+
+    if (fclose(file) != 0 || !ok) {
+        fprintf(stderr, "Error at bundle writing: cannot write %s\n", path);
+        return false;
+    }
+    return true;
+}
+
+// -------------------------
+// Lookups and cleanup
+// -------------------------
+
+/// Whether the texel lies in an opaque run of its column
+bool asset_opaque(const asset_t* asset, int x, int y) {
+    for (Uint32 r = asset->column_runs[x]; r < asset->column_runs[x + 1]; r++) {
+        if (y < asset->runs[r].start) {
+            return false;
+        }
+        if (y < asset->runs[r].end) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void free_assets() {
+    for (int i = 0; i < ASSET_COUNT; i++) {
+        asset_t* asset = &assets[i];
+        if (asset->surface != NULL) {
+            SDL_FreeSurface(asset->surface); // Does not free pixels it does not own
+        }
+        if (!asset->mapped) {
+            free(asset->data);
+        }
+        free(asset->rows);
+        free(asset->columns);
+        free(asset->runs);
+        free(asset->column_runs);
+        asset->surface = NULL;
+        asset->rows = NULL;
+        asset->columns = NULL;
+        asset->runs = NULL;
+        asset->column_runs = NULL;
+        asset->data = NULL;
+        asset->size = 0;
+        asset->mapped = false;
+    }
+    if (image_loader_ready) {
+        IMG_Quit();
+        image_loader_ready = false;
+    }
+    if (bundle_data != NULL) {
+        munmap(bundle_data, bundle_size);
+        bundle_data = NULL;
+    }
+}
@@ -0,0 +1,201 @@
+#include "capture.h"
+#include "arena.h"
+#include <pthread.h>
+#include <semaphore.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Single producer (game loop), single consumer (writer thread) ring of
+// preallocated ARGB8888 frames. The game never waits: when every slot is
+// still waiting to be written, the frame is dropped and counted.
+static struct {
+    bool running;
+    capture_format format;
+    FILE* file;
+    int width;
+    int height;
+    Uint32* frames[CAPTURE_RING_SIZE];
+    arena_t scratch;   // Converted frames (RGB or YUV), writer thread only
+    atomic_ulong head; // Next slot filled by the game
+    atomic_ulong tail; // Next slot written to disk
+    atomic_bool stopping;
+    atomic_bool failed; // A write failed: nothing more is captured
+    sem_t ready;        // One post per submitted frame
+    pthread_t writer;
+    unsigned long written;
+    unsigned long dropped;
+} capture;
+
+static inline unsigned char clamp_byte(int v) { return v < 0 ? 0 : v > 255 ? 255 : v; }
+
+static bool write_ppm(const Uint32* frame) {
+    unsigned char* _rgb = arena_alloc(&capture.scratch, capture.width * capture.height * 3);
+    unsigned char* out = _rgb;
+    for (int i = 0; i < capture.width * capture.height; i++) {
+        *out++ = frame[i] >> 16;
+        *out++ = frame[i] >> 8;
+        *out++ = frame[i];
+    }
+    return fprintf(capture.file, "P6\n%d %d\n255\n", capture.width, capture.height) > 0 &&
+           fwrite(_rgb, 3, capture.width * capture.height, capture.file) ==
+               (size_t)(capture.width * capture.height);
+}
+
+/// Full range BT.601 conversion, chroma averaged over 2x2 blocks (4:2:0)
+static bool write_y4m(const Uint32* frame) {
+    int w = capture.width, h = capture.height;
+    size_t _size = w * h + 2 * (w / 2) * (h / 2);
+    unsigned char* y_plane = arena_alloc(&capture.scratch, _size);
+    unsigned char* u_plane = y_plane + w * h;
+    unsigned char* v_plane = u_plane + (w / 2) * (h / 2);
+
+    for (int i = 0; i < w * h; i++) {
+        int r = (frame[i] >> 16) & 0xff, g = (frame[i] >> 8) & 0xff, b = frame[i] & 0xff;
+        y_plane[i] = clamp_byte((77 * r + 150 * g + 29 * b) >> 8);
+    }
+    for (int y = 0; y < h / 2; y++) {
+        for (int x = 0; x < w / 2; x++) {
+            int r = 0, g = 0, b = 0;
+            for (int k = 0; k < 4; k++) {
+                Uint32 p = frame[(2 * y + k / 2) * w + 2 * x + k % 2];
+                r += (p >> 16) & 0xff;
+                g += (p >> 8) & 0xff;
+                b += p & 0xff;
+            }
+            r /= 4, g /= 4, b /= 4;
+            u_plane[y * (w / 2) + x] = clamp_byte(128 + ((-43 * r - 85 * g + 128 * b) >> 8));
+            v_plane[y * (w / 2) + x] = clamp_byte(128 + ((128 * r - 107 * g - 21 * b) >> 8));
+        }
+    }
+    return fputs("FRAME\n", capture.file) >= 0 && fwrite(y_plane, 1, _size, capture.file) == _size;
+}
+
+static void* capture_writer(void* arg) {
+    for (;;) {
+        sem_wait(&capture.ready);
+        unsigned long _tail = atomic_load(&capture.tail);
+        if (_tail == atomic_load(&capture.head)) {
+            if (atomic_load(&capture.stopping)) {
+                break; // Everything submitted has been written
+            }
+            continue;
+        }
+
+        const Uint32* frame = capture.frames[_tail % CAPTURE_RING_SIZE];
+        arena_reset(&capture.scratch);
+        bool _ok = capture.format == CAPTURE_Y4M ? write_y4m(frame) : write_ppm(frame);
+        if (!_ok) {
+            // Full disk or I/O error: the frames after it are not captured
+            fprintf(stderr, "Error at capture: cannot write frame %lu\n", capture.written);
+            atomic_store(&capture.failed, true);
+            break;
+        }
+        capture.written++;
+        atomic_store(&capture.tail, _tail + 1); // Hands the slot back to the game
+    }
+    return NULL;
+}
+
+static void free_buffers() {
+    for (int i = 0; i < CAPTURE_RING_SIZE; i++) {
+        free(capture.frames[i]);
+        capture.frames[i] = NULL;
+    }
+    arena_free(&capture.scratch);
+}
+
+/// Opens the output (.y4m for a YUV4MPEG2 stream, anything else for
+/// concatenated binary PPM frames) and starts the writer thread
+bool capture_start(const char* path, int width, int height, int fps) {
+    const char* ext = strrchr(path, '.');
+    capture.format = ext != NULL && !strcmp(ext, ".y4m") ? CAPTURE_Y4M : CAPTURE_PPM;
+    if (capture.format == CAPTURE_Y4M && (width % 2 != 0 || height % 2 != 0)) {
+        // 4:2:0 chroma would silently drop the last row or column
+        fprintf(stderr, "Error at capture: %s needs an even width and height\n", path);
+        return false;
+    }
+    capture.width = width;
+    capture.height = height;
+    capture.written = 0;
+    capture.dropped = 0;
+    atomic_init(&capture.head, 0);
+    atomic_init(&capture.tail, 0);
+    atomic_init(&capture.stopping, false);
+    atomic_init(&capture.failed, false);
+
+    capture.file = fopen(path, "wb");
+    if (capture.file == NULL) {
+        fprintf(stderr, "Error at capture: cannot open %s\n", path);
+        return false;
+    }
+    setvbuf(capture.file, NULL, _IOFBF, 1 << 20);
+    if (capture.format == CAPTURE_Y4M &&
+        fprintf(capture.file, "YUV4MPEG2 W%d H%d F%d:1 Ip A1:1 C420jpeg\n", width, height,
+                fps) < 0) {
+        fprintf(stderr, "Error at capture: cannot write %s\n", path);
+        fclose(capture.file);
+        return false;
+    }
+
+    // Both conversions fit in 3 bytes per pixel
+    bool _ok = arena_init(&capture.scratch, (size_t)width * height * 3);
+    for (int i = 0; i < CAPTURE_RING_SIZE; i++) {
+        capture.frames[i] = malloc((size_t)width * height * sizeof(Uint32));
+        _ok = _ok && capture.frames[i] != NULL;
+    }
+    bool _ready = _ok && sem_init(&capture.ready, 0, 0) == 0;
+    if (!_ready || pthread_create(&capture.writer, NULL, capture_writer, NULL) != 0) {
+        fprintf(stderr, "Error at capture: cannot start the writer\n");
+        if (_ready) {
+            sem_destroy(&capture.ready);
+        }
+        free_buffers();
+        fclose(capture.file);
+        return false;
+    }
+    capture.running = true;
+    return true;
+}
+
+/// Returns a free frame to fill, or NULL if the capture is off, stopped by
+/// a write error, or if the writer is late (the frame is then counted as
+/// dropped)
+Uint32* capture_acquire() {
+    if (!capture.running || atomic_load(&capture.failed)) {
+        return NULL;
+    }
+    unsigned long _head = atomic_load(&capture.head);
+    if (_head - atomic_load(&capture.tail) >= CAPTURE_RING_SIZE) {
+        capture.dropped++;
+        return NULL;
+    }
+    return capture.frames[_head % CAPTURE_RING_SIZE];
+}
+
+/// Queues the frame returned by the last capture_acquire
+void capture_submit() {
+    atomic_fetch_add(&capture.head, 1);
+    sem_post(&capture.ready);
+}
+
+/// Flushes the queued frames, stops the writer and prints the statistics
+void capture_stop() {
+    if (!capture.running) {
+        return;
+    }
+    atomic_store(&capture.stopping, true);
+    sem_post(&capture.ready);
+    pthread_join(capture.writer, NULL);
+
+    if (fclose(capture.file) != 0 && !atomic_load(&capture.failed)) {
+        fprintf(stderr, "Error at capture: cannot write the last frames\n");
+        atomic_store(&capture.failed, true);
+    }
+    sem_destroy(&capture.ready);
+    free_buffers();
+    capture.running = false;
+    printf("[ CAPTURE ] %lu frames written, %lu dropped%s\n", capture.written, capture.dropped,
+           atomic_load(&capture.failed) ? ", stopped by a write error" : "");
+}
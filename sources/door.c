@@ -0,0 +1,158 @@
+#include "door.h"
+#include "map.h"
+#include "pathfinding.h"
+#include <stddef.h>
+
+_Thread_local door_set_t* door_set = NULL;
+
+void reset_doors() {
+    door_set->door_number = 0;
+    door_set->active_door_number = 0;
+    for (int i = 0; i < DOOR_TABLE_SIZE; i++) {
+        door_set->door_table[i] = -1;
+    }
+}
+
+static unsigned door_hash(int col, int row) {
+    return ((unsigned)col * 73856093u ^ (unsigned)row * 19349663u) & (DOOR_TABLE_SIZE - 1);
+}
+
+static int* door_slot(int col, int row) {
+    unsigned _slot = door_hash(col, row);
+    for (; door_set->door_table[_slot] != -1; _slot = (_slot + 1) & (DOOR_TABLE_SIZE - 1)) {
+        door_t* _door = &door_set->doors[door_set->door_table[_slot]];
+        if (_door->col == col && _door->row == row) {
+            break;
+        }
+    }
+    return &door_set->door_table[_slot];
+}
+
+/// Registered door at the given tile, NULL if it was never looked up with
+/// door_at (it is then closed)
+door_t* door_find(int col, int row) {
+    int _idx = *door_slot(col, row);
+    return _idx == -1 ? NULL : &door_set->doors[_idx];
+}
+
+/// Door on the given 'p' tile, registered (closed) on the first lookup.
+/// NULL for other tiles, or when MAX_DOORS doors are already known.
+door_t* door_at(int col, int row) {
+    if (world_tile(col, row) != 'p') {
+        return NULL;
+    }
+    int* _slot = door_slot(col, row);
+    if (*_slot != -1) {
+        return &door_set->doors[*_slot];
+    }
+    if (door_set->door_number == MAX_DOORS) {
+        return NULL;
+    }
+    door_set->doors[door_set->door_number] = (door_t){col, row, 0, 0, 0, false};
+    *_slot = door_set->door_number;
+    return &door_set->doors[door_set->door_number++];
+}
+
+bool door_is_open(int col, int row) {
+    door_t* _door = door_find(col, row);
+    return _door != NULL && _door->open == TILE_WIDTH;
+}
+
+static void activate_door(door_t* door) {
+    if (!door->active) {
+        door->active = true;
+        door_set->active_doors[door_set->active_door_number++] = door - door_set->doors;
+    }
+}
+
+/// Opens a closed (or closing) door, closes an opened (or opening) one
+void toggle_door(door_t* door) {
+    if (door->direction == 1 || (door->direction == 0 && door->open == TILE_WIDTH)) {
+        door->direction = -1;
+        if (door->open == TILE_WIDTH) {
+            world_update_tile(door->col, door->row);
+            flow_field_tile_changed(door->col, door->row); // Enemies cannot go through anymore
+        }
+    } else {
+        door->direction = 1;
+    }
+    activate_door(door);
+}
+
+/// Animates the active doors and removes the idle ones from the list
+void update_doors(vector_t player_pos) {
+    int _player_col = (int)player_pos.x / TILE_WIDTH;
+    int _player_row = (int)player_pos.y / TILE_HEIGHT;
+
+    for (int i = 0; i < door_set->active_door_number;) {
+        door_t* _door = &door_set->doors[door_set->active_doors[i]];
+        if (_door->direction != 0) {
+            world_revise();
+        }
+
+        if (_door->direction == 1) {
+            _door->open += DOOR_SPEED;
+            if (_door->open >= TILE_WIDTH) {
+                _door->open = TILE_WIDTH;
+                _door->direction = 0;
+                _door->timer = DOOR_OPEN_DELAY;
+                world_update_tile(_door->col, _door->row);
+                flow_field_tile_changed(_door->col, _door->row); // Enemies can now walk through
+            }
+        } else if (_door->direction == -1) {
+            _door->open -= DOOR_SPEED;
+            if (_door->open <= 0) {
+                _door->open = 0;
+                _door->direction = 0;
+            }
+        } else if (_door->open == TILE_WIDTH) {
+            // A door never closes on the player, nor on a prop or an enemy
+            // that would be stuck in the wall
+            bool _blocked = (_door->col == _player_col && _door->row == _player_row) ||
+                            world_blocked(_door->col, _door->row);
+            if (!_blocked && --_door->timer <= 0) {
+                toggle_door(_door);
+            }
+        }
+
+        if (_door->direction == 0 && _door->open == 0) {
+            // Closed and idle: swap-remove from the active list
+            _door->active = false;
+            door_set->active_doors[i] = door_set->active_doors[--door_set->active_door_number];
+        } else {
+            i++;
+        }
+    }
+}
+
+/// Forgets the closed and still doors of the chunk whose top-left tile is at
+/// (col, row), which is being evicted: door_at registers them again as they
+/// were, closed
+void forget_doors(int col, int row) {
+    int _kept = 0;
+    for (int i = 0; i < door_set->door_number; i++) {
+        door_t* _door = &door_set->doors[i];
+        if (_door->open == 0 && _door->direction == 0 && _door->col >= col &&
+            _door->col < col + CHUNK_SIZE && _door->row >= row && _door->row < row + CHUNK_SIZE) {
+            continue;
+        }
+        door_set->doors[_kept++] = *_door;
+    }
+    if (_kept == door_set->door_number) {
+        return;
+    }
+
+    // Indices moved: the table and the active list are built again
+    door_set->door_number = _kept;
+    door_set->active_door_number = 0;
+    for (int i = 0; i < DOOR_TABLE_SIZE; i++) {
+        door_set->door_table[i] = -1;
+    }
+    for (int i = 0; i < door_set->door_number; i++) {
+        door_t* _door = &door_set->doors[i];
+        *door_slot(_door->col, _door->row) = i;
+        if (_door->active) {
+            door_set->active_doors[door_set->active_door_number++] = i;
+        }
+    }
+}
@@ -0,0 +1,90 @@
+#include "geometry.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+/// Starts collecting quads for the given texture. Pending quads must have
+/// been flushed before switching to another texture.
+void batch_begin(geometry_batch_t* batch, SDL_Texture* texture, int width, int height) {
+    batch->texture = texture;
+    batch->texture_width = width;
+    batch->texture_height = height;
+    batch->vertex_number = 0;
+    batch->index_number = 0;
+}
+
+static bool batch_reserve(geometry_batch_t* batch, int vertices, int indices) {
+    if (batch->vertex_number + vertices > batch->vertex_capacity) {
+        int _capacity = batch->vertex_capacity ? 2 * batch->vertex_capacity : 4096;
+        SDL_Vertex* _vertices = realloc(batch->vertices, _capacity * sizeof(SDL_Vertex));
+        if (_vertices == NULL) {
+            return false;
+        }
+        batch->vertices = _vertices;
+        batch->vertex_capacity = _capacity;
+    }
+    if (batch->index_number + indices > batch->index_capacity) {
+        int _capacity = batch->index_capacity ? 2 * batch->index_capacity : 6144;
+        int* _indices = realloc(batch->indices, _capacity * sizeof(int));
+        if (_indices == NULL) {
+            return false;
+        }
+        batch->indices = _indices;
+        batch->index_capacity = _capacity;
+    }
+    return true;
+}
+
+/// Appends the src texels of the batch texture stretched over dst. The color
+/// modulates the texels, which is how the walls are shaded.
+void batch_push_quad(geometry_batch_t* batch, const SDL_Rect* src, const SDL_FRect* dst,
+                     SDL_Color color) {
+    if (!batch_reserve(batch, 4, 6)) {
+        fprintf(stderr, "Error at geometry batching: out of memory\n");
+        return;
+    }
+
+    float u0 = src->x / batch->texture_width;
+    float v0 = src->y / batch->texture_height;
+    float u1 = (src->x + src->w) / batch->texture_width;
+    float v1 = (src->y + src->h) / batch->texture_height;
+
+    int _base = batch->vertex_number;
+    SDL_Vertex* v = &batch->vertices[_base];
+    v[0] = (SDL_Vertex){{dst->x, dst->y}, color, {u0, v0}};
+    v[1] = (SDL_Vertex){{dst->x + dst->w, dst->y}, color, {u1, v0}};
+    v[2] = (SDL_Vertex){{dst->x + dst->w, dst->y + dst->h}, color, {u1, v1}};
+    v[3] = (SDL_Vertex){{dst->x, dst->y + dst->h}, color, {u0, v1}};
+    batch->vertex_number += 4;
+
+    int* i = &batch->indices[batch->index_number];
+    i[0] = _base;
+    i[1] = _base + 1;
+    i[2] = _base + 2;
+    i[3] = _base;
+    i[4] = _base + 2;
+    i[5] = _base + 3;
+    batch->index_number += 6;
+}
+
+/// Submits every pending quad with a single SDL_RenderGeometry call
+bool batch_flush(SDL_Renderer* renderer, geometry_batch_t* batch) {
+    if (batch->index_number == 0) {
+        return true;
+    }
+    int _ret = SDL_RenderGeometry(renderer, batch->texture, batch->vertices, batch->vertex_number,
+                                  batch->indices, batch->index_number);
+    batch->vertex_number = 0;
+    batch->index_number = 0;
+    batch->submissions++;
+    if (_ret < 0) {
+        fprintf(stderr, "Error on SDL_RenderGeometry: %s\n", SDL_GetError());
+        return false;
+    }
+    return true;
+}
+
+void batch_free(geometry_batch_t* batch) {
+    free(batch->vertices);
+    free(batch->indices);
+    *batch = (geometry_batch_t){0};
+}
@@ -0,0 +1,52 @@
+#include "hud.h"
+#include <stdio.h>
+
+// Every printable character rendered once, side by side, by a monospaced
+// font: drawing text is a few blits out of it, nothing is rendered nor
+// allocated per frame
+static SDL_Surface* atlas = NULL;
+static int glyph_width = 0;
+
+bool hud_init(TTF_Font* font, SDL_Color color) {
+    char _glyphs[HUD_LAST_GLYPH - HUD_FIRST_GLYPH + 2];
+    for (int c = HUD_FIRST_GLYPH; c <= HUD_LAST_GLYPH; c++) {
+        _glyphs[c - HUD_FIRST_GLYPH] = c;
+    }
+    _glyphs[sizeof(_glyphs) - 1] = '\0';
+
+    SDL_Surface* _text = TTF_RenderText_Solid(font, _glyphs, color);
+    if (_text == NULL) {
+        fprintf(stderr, "Error on TTF_RenderText_Solid: %s\n", TTF_GetError());
+        return false;
+    }
+    // Same layout as the image assets, so no backend has to convert it
+    atlas = SDL_ConvertSurfaceFormat(_text, SDL_PIXELFORMAT_ARGB8888, 0);
+    SDL_FreeSurface(_text);
+    if (atlas == NULL) {
+        fprintf(stderr, "Error on SDL_ConvertSurfaceFormat: %s\n", SDL_GetError());
+        return false;
+    }
+    glyph_width = atlas->w / (sizeof(_glyphs) - 1);
+    return true;
+}
+
+void hud_draw_text(render_backend_t* backend, int x, int y, const char* text) {
+    if (atlas == NULL) {
+        return;
+    }
+    for (; *text != '\0'; text++, x += glyph_width) {
+        if (*text <= HUD_FIRST_GLYPH || *text > HUD_LAST_GLYPH) {
+            continue; // Spaces (and anything unknown) only move the pen
+        }
+        SDL_Rect _src = {(*text - HUD_FIRST_GLYPH) * glyph_width, 0, glyph_width, atlas->h};
+        SDL_Rect _dst = {x, y, glyph_width, atlas->h};
+        backend->blit_hud(backend, atlas, &_src, &_dst);
+    }
+}
+
+void hud_free() {
+    if (atlas != NULL) {
+        SDL_FreeSurface(atlas);
+        atlas = NULL;
+    }
+}
@@ -0,0 +1,231 @@
+#include "input.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define INPUT_FIRING 0x1
+#define INPUT_USE_DOOR 0x2
+#define INPUT_RELOAD 0x4
+#define INPUT_QUIT 0x8
+
+static FILE* record_file = NULL;
+static bool recorded_firing = false; // Firing is a state, only its changes are logged
+static long recorded_frame = -1;     // Last frame seen by the recorder
+static bool recorded_quit = false;
+static input_record_t recorded_last = {.frame = UINT32_MAX}; // Last record written
+
+static input_record_t* replay_records = NULL;
+static size_t replay_number = 0;
+static size_t replay_next = 0;
+static bool replay_firing = false;
+
+// Input to present latency (--latency): the time stamp of every event waits
+// for the present of the first frame showing it, in milliseconds
+static bool latency_running = false;
+static uint32_t latency_due[INPUT_LATENCY_PENDING];   // Shown by the next present
+static uint32_t latency_later[INPUT_LATENCY_PENDING]; // Shown by the one after
+static int latency_due_number = 0;
+static int latency_later_number = 0;
+static unsigned long latency_histogram[INPUT_LATENCY_MAX_MS + 1];
+static unsigned long latency_events = 0;
+static unsigned long latency_skipped = 0;
+static uint64_t latency_total = 0;
+static uint32_t latency_max = 0;
+
+bool input_record_start(const char* path) {
+    record_file = fopen(path, "wb");
+    if (record_file == NULL) {
+        fprintf(stderr, "Error at input recording: cannot open %s\n", path);
+        return false;
+    }
+    uint32_t _version = INPUT_LOG_VERSION;
+    fwrite(INPUT_LOG_MAGIC, 1, 8, record_file);
+    fwrite(&_version, sizeof(_version), 1, record_file);
+    recorded_firing = false;
+    recorded_frame = -1;
+    recorded_quit = false;
+    recorded_last.frame = UINT32_MAX;
+    return true;
+}
+
+/// Logs the input of a frame if it differs from doing nothing
+void input_record(long frame, const frame_input_t* input) {
+    if (record_file == NULL) {
+        return;
+    }
+    recorded_frame = frame;
+    recorded_quit = input->quit;
+
+    uint8_t _flags = (input->firing ? INPUT_FIRING : 0) | (input->use_door ? INPUT_USE_DOOR : 0) |
+                     (input->reload ? INPUT_RELOAD : 0) | (input->quit ? INPUT_QUIT : 0);
+    bool _idle = input->step_forward == 0 && input->step_side == 0 && input->mouse_delta == 0 &&
+                 (_flags & ~INPUT_FIRING) == 0 && input->firing == recorded_firing;
+    if (_idle) {
+        return;
+    }
+
+    input_record_t _record = {
+        frame, input->step_forward, input->step_side, input->mouse_delta, _flags, 0};
+    fwrite(&_record, sizeof(_record), 1, record_file);
+    recorded_firing = input->firing;
+    recorded_last = _record;
+}
+
+bool input_replay_start(const char* path) {
+    FILE* file = fopen(path, "rb");
+    if (file == NULL) {
+        fprintf(stderr, "Error at input replay: cannot open %s\n", path);
+        return false;
+    }
+
+    char _magic[8];
+    uint32_t _version;
+    if (fread(_magic, 1, 8, file) != 8 || memcmp(_magic, INPUT_LOG_MAGIC, 8) != 0 ||
+        fread(&_version, sizeof(_version), 1, file) != 1 || _version != INPUT_LOG_VERSION) {
+        fprintf(stderr, "Error at input replay: %s is not an input log\n", path);
+        fclose(file);
+        return false;
+    }
+
+    long _start = ftell(file);
+    long _end = fseek(file, 0, SEEK_END) == 0 ? ftell(file) : -1;
+    if (_start < 0 || _end < 0 || fseek(file, _start, SEEK_SET) != 0 ||
+        (_end - _start) % sizeof(input_record_t) != 0) {
+        fprintf(stderr, "Error at input replay: %s is truncated\n", path);
+        fclose(file);
+        return false;
+    }
+    replay_number = (_end - _start) / sizeof(input_record_t);
+
+    replay_records = malloc(replay_number * sizeof(input_record_t) + 1);
+    if (replay_records == NULL ||
+        fread(replay_records, sizeof(input_record_t), replay_number, file) != replay_number) {
+        fprintf(stderr, "Error at input replay: cannot read %s\n", path);
+        free(replay_records);
+        replay_records = NULL; // Not replaying
+        replay_number = 0;
+        fclose(file);
+        return false;
+    }
+    fclose(file);
+    replay_next = 0;
+    replay_firing = false;
+    return true;
+}
+
+/// Fills the input of the given frame from the log, taking every record up
+/// to it so that none is left behind. Returns false once the whole log has
+/// been played.
+bool input_replay(long frame, frame_input_t* input) {
+    memset(input, 0, sizeof(*input));
+    if (replay_next >= replay_number) {
+        return false;
+    }
+
+    while (replay_next < replay_number && replay_records[replay_next].frame <= (uint32_t)frame) {
+        input_record_t* _record = &replay_records[replay_next];
+        input->step_forward = _record->step_forward;
+        input->step_side = _record->step_side;
+        input->mouse_delta = _record->mouse_delta;
+        input->use_door |= (_record->flags & INPUT_USE_DOOR) != 0;
+        input->reload |= (_record->flags & INPUT_RELOAD) != 0;
+        input->quit |= (_record->flags & INPUT_QUIT) != 0;
+        replay_firing = _record->flags & INPUT_FIRING;
+        replay_next++;
+    }
+    input->firing = replay_firing;
+    return true;
+}
+
+bool input_replaying() { return replay_records != NULL; }
+
+void input_latency_start() {
+    latency_running = true;
+    latency_due_number = 0;
+    latency_later_number = 0;
+    memset(latency_histogram, 0, sizeof(latency_histogram));
+    latency_events = 0;
+    latency_skipped = 0;
+    latency_total = 0;
+    latency_max = 0;
+}
+
+/// Stamps an event, shown by the next present, or by the one after for the
+/// actions the simulation has to run first (next_frame)
+void input_latency_event(uint32_t timestamp, bool next_frame) {
+    if (!latency_running) {
+        return;
+    }
+    if (next_frame && latency_later_number < INPUT_LATENCY_PENDING) {
+        latency_later[latency_later_number++] = timestamp;
+    } else if (!next_frame && latency_due_number < INPUT_LATENCY_PENDING) {
+        latency_due[latency_due_number++] = timestamp;
+    } else {
+        latency_skipped++;
+    }
+}
+
+/// Counts the events shown by the frame just presented, at time now
+void input_latency_present(uint32_t now) {
+    if (!latency_running) {
+        return;
+    }
+    for (int i = 0; i < latency_due_number; i++) {
+        uint32_t _latency = now - latency_due[i];
+        latency_histogram[_latency < INPUT_LATENCY_MAX_MS ? _latency : INPUT_LATENCY_MAX_MS]++;
+        latency_total += _latency;
+        latency_max = _latency > latency_max ? _latency : latency_max;
+    }
+    latency_events += latency_due_number;
+    memcpy(latency_due, latency_later, latency_later_number * sizeof(uint32_t));
+    latency_due_number = latency_later_number;
+    latency_later_number = 0;
+}
+
+/// Latency under which that fraction of the events were shown
+static int latency_percentile(double fraction) {
+    unsigned long _count = 0;
+    for (int i = 0; i < INPUT_LATENCY_MAX_MS; i++) {
+        _count += latency_histogram[i];
+        if (_count >= fraction * latency_events) {
+            return i;
+        }
+    }
+    return INPUT_LATENCY_MAX_MS;
+}
+
+static void print_latency() {
+    if (latency_events == 0) {
+        printf("[ LATENCY ] no input event presented\n");
+        return;
+    }
+    printf("[ LATENCY ] %lu events, input to present: %.1f ms on average, 50%% within %d ms, "
+           "90%% within %d ms, 99%% within %d ms, %u ms at most (%lu skipped)\n",
+           latency_events, (double)latency_total / latency_events, latency_percentile(0.5),
+           latency_percentile(0.9), latency_percentile(0.99), latency_max, latency_skipped);
+}
+
+void input_stop() {
+    if (record_file != NULL) {
+        // The replay must end on the same frame, whatever ended the session:
+        // the quit goes into the record of that frame if it was logged
+        if (!recorded_quit && recorded_frame >= 0 &&
+            recorded_last.frame == (uint32_t)recorded_frame) {
+            recorded_last.flags |= INPUT_QUIT;
+            fseek(record_file, -(long)sizeof(input_record_t), SEEK_END);
+            fwrite(&recorded_last, sizeof(recorded_last), 1, record_file);
+        } else if (!recorded_quit && recorded_frame >= 0) {
+            frame_input_t _quit = {.firing = recorded_firing, .quit = true};
+            input_record(recorded_frame, &_quit);
+        }
+        fclose(record_file);
+        record_file = NULL;
+    }
+    free(replay_records);
+    replay_records = NULL;
+    replay_number = 0;
+    if (latency_running) {
+        print_latency();
+        latency_running = false;
+    }
+}
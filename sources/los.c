@@ -0,0 +1,341 @@
+#include "los.h"
+#include "constants.h"
+#include "map.h"
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+_Thread_local los_t* los = NULL;
+
+#define LOS_HIDDEN -1
+#define LOS_VISIBLE -2
+
+// Workers, woken for each batch worth splitting. They serve one game at a
+// time: the batches of the others are walked by their caller meanwhile.
+static pthread_t workers[LOS_MAX_THREADS];
+static int worker_count = 0;
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t wake = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t done = PTHREAD_COND_INITIALIZER;
+static unsigned long batch = 0;
+static int busy = 0;
+static bool stopping = false;
+static atomic_bool taken = false; // A game is using the workers
+static los_t* batch_los = NULL;   // Batch in progress, and the world it walks
+static world_t* batch_world = NULL;
+
+// -------------------------
+// Grid walk
+// -------------------------
+
+/// Walks the tiles between the centers of two tiles, stopping on the first
+/// solid one. The tiles at both ends do not count: the enemy standing in
+/// an opened door still sees.
+static bool walk_sight(int from_col, int from_row, int to_col, int to_row,
+                       bool (*solid)(int col, int row)) {
+    int _dx = to_col - from_col, _dy = to_row - from_row;
+    int _step_col = _dx > 0 ? 1 : -1, _step_row = _dy > 0 ? 1 : -1;
+    int _nx = abs(_dx), _ny = abs(_dy);
+    int _col = from_col, _row = from_row;
+
+    // Both centers are on half tiles: comparing (0.5 + i) / nx against
+    // (0.5 + j) / ny tells which grid line comes first, in integers
+    for (int i = 0, j = 0; i + j < _nx + _ny - 1;) {
+        if ((1 + 2 * i) * _ny < (1 + 2 * j) * _nx) {
+            _col += _step_col;
+            i++;
+        } else {
+            _row += _step_row;
+            j++;
+        }
+        if (solid(_col, _row)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/// world_solid, paging the chunk in if needed: game thread only
+static bool paged_solid(int col, int row) { return world_solid(col, row); }
+
+static void run_walks(los_t* self) {
+    for (;;) {
+        int _start = atomic_fetch_add(&self->next_walk, LOS_GRAIN);
+        if (_start >= self->walk_end) {
+            return;
+        }
+        int _end = _start + LOS_GRAIN < self->walk_end ? _start + LOS_GRAIN : self->walk_end;
+        for (int i = _start; i < _end; i++) {
+            los_walk_t* walk = &self->walks[i];
+            walk->visible = walk_sight(walk->from_col, walk->from_row, walk->to_col, walk->to_row,
+                                       world_peek_solid);
+        }
+    }
+}
+
+static void* los_worker(void* arg) {
+    (void)arg;
+    unsigned long _seen = 0;
+    pthread_mutex_lock(&lock);
+    for (;;) {
+        while (batch == _seen && !stopping) {
+            pthread_cond_wait(&wake, &lock);
+        }
+        if (stopping) {
+            break;
+        }
+        _seen = batch;
+        los_t* _los = batch_los;
+        world = batch_world;
+        pthread_mutex_unlock(&lock);
+        run_walks(_los);
+        pthread_mutex_lock(&lock);
+        if (--busy == 0) {
+            pthread_cond_signal(&done);
+        }
+    }
+    pthread_mutex_unlock(&lock);
+    return NULL;
+}
+
+// -------------------------
+// Batches
+// -------------------------
+
+/// Starts the workers, one per spare core. Without them, the batches are
+/// walked by the caller.
+void los_start() {
+    long _cores = sysconf(_SC_NPROCESSORS_ONLN);
+    int _wanted = _cores > 1 ? _cores - 1 : 0;
+    if (_wanted > LOS_MAX_THREADS) {
+        _wanted = LOS_MAX_THREADS;
+    }
+    stopping = false;
+    for (worker_count = 0; worker_count < _wanted; worker_count++) {
+        if (pthread_create(&workers[worker_count], NULL, los_worker, NULL) != 0) {
+            fprintf(stderr, "Error at line of sight: %d workers only\n", worker_count);
+            break;
+        }
+    }
+}
+
+/// Forgets the answers and the statistics of the current game
+void los_reset() {
+    for (int i = 0; i < LOS_CACHE_SIZE; i++) {
+        los->cache[i].frame = 0;
+    }
+    los->frame = 1;
+    los->stats = (los_stats_t){0};
+}
+
+/// Forgets the answers cached so far: called once per frame, as doors and
+/// loaded chunks may have changed
+void los_new_frame() { los->frame++; }
+
+static bool grow(int count) {
+    if (count <= los->capacity) {
+        return true;
+    }
+    los_walk_t* _walks = realloc(los->walks, count * sizeof(los_walk_t));
+    if (_walks != NULL) {
+        los->walks = _walks;
+    }
+    int* _answers = realloc(los->answers, count * sizeof(int));
+    if (_answers != NULL) {
+        los->answers = _answers;
+    }
+    if (_walks == NULL || _answers == NULL) {
+        fprintf(stderr, "Error at line of sight: %d queries are too many\n", count);
+        return false;
+    }
+    los->capacity = count;
+    return true;
+}
+
+static bool in_world(int col, int row) {
+    return col >= 0 && col < world->width && row >= 0 && row < world->height;
+}
+
+/// Cache entry of the pair, found or claimed for this frame. NULL if the
+/// few slots it may use are taken by other pairs.
+static los_entry_t* find_entry(uint64_t key, bool* found) {
+    unsigned _slot = (key * 0x9E3779B97F4A7C15ull) >> 52;
+    for (int probe = 0; probe < 8; probe++) {
+        los_entry_t* entry = &los->cache[(_slot + probe) & (LOS_CACHE_SIZE - 1)];
+        if (entry->frame != los->frame) {
+            *entry = (los_entry_t){key, los->frame, -1, false};
+            *found = false;
+            return entry;
+        }
+        if (entry->key == key) {
+            *found = true;
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+// Tiles a group of walks goes through at most
+typedef struct {
+    int min_col, min_row;
+    int max_col, max_row;
+} los_box_t;
+
+/// Adds the tiles of the walk to the box. Pairs are ordered by index: rows
+/// never decrease from one end to the other.
+static void grow_box(los_box_t* box, const los_walk_t* walk) {
+    int _low_col = walk->from_col < walk->to_col ? walk->from_col : walk->to_col;
+    int _high_col = walk->from_col < walk->to_col ? walk->to_col : walk->from_col;
+    box->min_col = _low_col < box->min_col ? _low_col : box->min_col;
+    box->max_col = _high_col > box->max_col ? _high_col : box->max_col;
+    box->min_row = walk->from_row < box->min_row ? walk->from_row : box->min_row;
+    box->max_row = walk->to_row > box->max_row ? walk->to_row : box->max_row;
+}
+
+/// Chunks of the box, once grown by the walk
+static int box_chunks(los_box_t box, const los_walk_t* walk) {
+    grow_box(&box, walk);
+    return (box.max_col / CHUNK_SIZE - box.min_col / CHUNK_SIZE + 1) *
+           (box.max_row / CHUNK_SIZE - box.min_row / CHUNK_SIZE + 1);
+}
+
+/// Walks the group of walks from first to end, across the workers if it is
+/// worth it and they are free
+static void run_group(int first, int end) {
+    atomic_store(&los->next_walk, first);
+    los->walk_end = end;
+    bool _parallel = worker_count > 0 && end - first >= LOS_MIN_PARALLEL;
+    if (_parallel && !atomic_exchange(&taken, true)) {
+        pthread_mutex_lock(&lock);
+        busy = worker_count;
+        batch++;
+        batch_los = los;
+        batch_world = world;
+        pthread_cond_broadcast(&wake);
+        pthread_mutex_unlock(&lock);
+
+        run_walks(los);
+
+        pthread_mutex_lock(&lock);
+        while (busy > 0) {
+            pthread_cond_wait(&done, &lock);
+        }
+        pthread_mutex_unlock(&lock);
+        atomic_store(&taken, false);
+    } else {
+        run_walks(los);
+    }
+}
+
+/// Sets the bit i of visible if the tiles of both ends of the query i see
+/// each other. The chunks between them are paged in first, a group of walks
+/// at a time, so that the answers never depend on the loader; the world must
+/// not change during the call, which waits for the workers.
+void los_batch(const los_query_t* queries, int count, uint32_t* visible) {
+    for (int i = 0; i < LOS_WORDS(count); i++) {
+        visible[i] = 0;
+    }
+    if (count <= 0 || !grow(count)) {
+        return;
+    }
+    los->stats.queries += count;
+    los->walk_count = 0;
+
+    for (int i = 0; i < count; i++) {
+        int _from_col = (int)queries[i].from.x / TILE_WIDTH;
+        int _from_row = (int)queries[i].from.y / TILE_HEIGHT;
+        int _to_col = (int)queries[i].to.x / TILE_WIDTH;
+        int _to_row = (int)queries[i].to.y / TILE_HEIGHT;
+        if (_from_col == _to_col && _from_row == _to_row) {
+            los->answers[i] = LOS_VISIBLE;
+            continue;
+        }
+        if (!in_world(_from_col, _from_row) || !in_world(_to_col, _to_row)) {
+            los->answers[i] = LOS_HIDDEN;
+            continue;
+        }
+
+        // Walked in a single direction, so both orders share an answer
+        uint64_t _a = (uint64_t)_from_row * world->width + _from_col;
+        uint64_t _b = (uint64_t)_to_row * world->width + _to_col;
+        if (_a > _b) {
+            uint64_t _swap = _a;
+            _a = _b;
+            _b = _swap;
+        }
+        bool _found = false;
+        los_entry_t* entry = find_entry(_a * world->width * world->height + _b, &_found);
+        if (_found) {
+            los->answers[i] =
+                entry->walk >= 0 ? entry->walk : entry->visible ? LOS_VISIBLE : LOS_HIDDEN;
+            continue;
+        }
+        los_walk_t _walk = {_a % world->width, _a / world->width, _b % world->width,
+                            _b / world->width, entry};
+        los->walks[los->walk_count] = _walk;
+        if (entry != NULL) {
+            entry->walk = los->walk_count;
+        }
+        los->answers[i] = los->walk_count++;
+    }
+    los->stats.walks += los->walk_count;
+
+    // A walk stays within the box of its ends. Consecutive walks are
+    // grouped while the box of the group fits LOS_PEEK_CHUNKS chunks, which
+    // are paged in before the group is walked: a larger box would evict its
+    // own chunks, and their tiles would be peeked as solid.
+    int _first = 0;
+    while (_first < los->walk_count) {
+        los_walk_t* walk = &los->walks[_first];
+        los_box_t _box = {world->width, world->height, -1, -1};
+        if (box_chunks(_box, walk) > LOS_PEEK_CHUNKS) {
+            // Too long for any group: walked alone here, paging its chunks in
+            walk->visible = walk_sight(walk->from_col, walk->from_row, walk->to_col, walk->to_row,
+                                       paged_solid);
+            _first++;
+            continue;
+        }
+        int _end = _first;
+        while (_end < los->walk_count && box_chunks(_box, &los->walks[_end]) <= LOS_PEEK_CHUNKS) {
+            grow_box(&_box, &los->walks[_end++]);
+        }
+        world_prepare_peek(_box.min_col, _box.min_row, _box.max_col, _box.max_row);
+        run_group(_first, _end);
+        _first = _end;
+    }
+
+    for (int i = 0; i < count; i++) {
+        int _answer = los->answers[i];
+        bool _visible = _answer >= 0 ? los->walks[_answer].visible : _answer == LOS_VISIBLE;
+        visible[i / 32] |= (uint32_t)_visible << (i % 32);
+    }
+    // Later batches of the frame read the answers from the cache
+    for (int i = 0; i < los->walk_count; i++) {
+        if (los->walks[i].entry != NULL) {
+            los->walks[i].entry->visible = los->walks[i].visible;
+            los->walks[i].entry->walk = -1;
+        }
+    }
+}
+
+/// Frees the batch buffers of the current game
+void los_free() {
+    free(los->walks);
+    free(los->answers);
+    los->walks = NULL;
+    los->answers = NULL;
+    los->capacity = 0;
+}
+
+void los_stop() {
+    pthread_mutex_lock(&lock);
+    stopping = true;
+    pthread_cond_broadcast(&wake);
+    pthread_mutex_unlock(&lock);
+    for (int i = 0; i < worker_count; i++) {
+        pthread_join(workers[i], NULL);
+    }
+    worker_count = 0;
+}
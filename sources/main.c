@@ -4,9 +4,23 @@
  *
  */
 
+#include "options.h"
+
 int start();
+int build_bundle();
+int build_world();
 
-int main(void) {
+int main(int argc, char** argv) {
+    if (!parse_options(argc, argv)) {
+        print_usage(argv[0]);
+        return 1;
+    }
+    if (options.bundle_output != 0) {
+        return build_bundle();
+    }
+    if (options.world_output != 0) {
+        return build_world();
+    }
     int status = start();
     return status;
 }
@@ -0,0 +1,996 @@
+#include "map.h"
+#include "door.h"
+#include "sprite.h"
+#include <fcntl.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+_Thread_local world_t* world = NULL;
+
+// -------------------------
+// Levels
+// -------------------------
+
+// Chunks of the world files before version 4, whose tiles see whole
+// chunks: one bit per chunk of the 5 x 5 square centered on their own
+#define LEGACY_PVS_RADIUS 2
+#define LEGACY_PVS_SPAN (2 * LEGACY_PVS_RADIUS + 1)
+
+typedef struct {
+    char tiles[CHUNK_SIZE][CHUNK_SIZE];
+    char sprites[CHUNK_SIZE][CHUNK_SIZE];
+    uint32_t pvs[CHUNK_SIZE][CHUNK_SIZE];
+    uint8_t floors[CHUNK_SIZE][CHUNK_SIZE];
+    uint8_t ceilings[CHUNK_SIZE][CHUNK_SIZE];
+} legacy_chunk_t;
+
+/// Everything is visible from every cell
+static void fill_pvs(chunk_data_t* data) { memset(data->pvs, 0xff, sizeof(data->pvs)); }
+
+/// Adds the cell (dx, dy) cells away from the one of a PVS to it, unless it
+/// lies outside of the PVS square
+static void pvs_set(uint32_t* pvs, int dx, int dy) {
+    if (dx >= -PVS_RADIUS && dx <= PVS_RADIUS && dy >= -PVS_RADIUS && dy <= PVS_RADIUS) {
+        int _bit = (dy + PVS_RADIUS) * PVS_SPAN + dx + PVS_RADIUS;
+        pvs[_bit / 32] |= 1u << (_bit % 32);
+    }
+}
+
+static void fill_floors(chunk_data_t* data) {
+    memset(data->floors, FLOOR_SLOT, sizeof(data->floors));
+    memset(data->ceilings, CEILING_SLOT, sizeof(data->ceilings));
+}
+
+static void fail_chunk(int index, chunk_data_t* data) {
+    fprintf(stderr, "Error at world loading: cannot read chunk %d\n", index);
+    memset(data->tiles, WORLD_BOUNDARY, sizeof(data->tiles));
+    memset(data->sprites, '.', sizeof(data->sprites));
+    fill_pvs(data);
+    fill_floors(data);
+}
+
+/// The cells of a version 3 chunk see all the cells of the chunks their
+/// tiles see
+static void widen_pvs(const legacy_chunk_t* legacy, chunk_data_t* data) {
+    memset(data->pvs, 0, sizeof(data->pvs));
+    for (int cy = 0; cy < PVS_CELLS; cy++) {
+        for (int cx = 0; cx < PVS_CELLS; cx++) {
+            uint32_t _mask = 0;
+            for (int y = cy * PVS_CELL; y < (cy + 1) * PVS_CELL; y++) {
+                for (int x = cx * PVS_CELL; x < (cx + 1) * PVS_CELL; x++) {
+                    _mask |= legacy->pvs[y][x];
+                }
+            }
+            for (int b = 0; b < LEGACY_PVS_SPAN * LEGACY_PVS_SPAN; b++) {
+                if (!((_mask >> b) & 1)) {
+                    continue;
+                }
+                // First cell of the chunk seen, relative to this cell
+                int _dx = (b % LEGACY_PVS_SPAN - LEGACY_PVS_RADIUS) * PVS_CELLS - cx;
+                int _dy = (b / LEGACY_PVS_SPAN - LEGACY_PVS_RADIUS) * PVS_CELLS - cy;
+                for (int y = 0; y < PVS_CELLS; y++) {
+                    for (int x = 0; x < PVS_CELLS; x++) {
+                        pvs_set(data->pvs[cy][cx], _dx + x, _dy + y);
+                    }
+                }
+            }
+        }
+    }
+}
+
+/// Reads a chunk of a world file older than version 4. Version 1 chunks
+/// stop before the PVS, version 2 ones before the floors.
+static void read_legacy_chunk(const level_t* level, int index, chunk_data_t* data) {
+    legacy_chunk_t legacy;
+    size_t _size = level->version == 1   ? offsetof(legacy_chunk_t, pvs)
+                   : level->version == 2 ? offsetof(legacy_chunk_t, floors)
+                                         : sizeof(legacy_chunk_t);
+    off_t _offset = sizeof(world_header_t) + (off_t)index * _size;
+    if (pread(level->fd, &legacy, _size, _offset) != (ssize_t)_size) {
+        fail_chunk(index, data);
+        return;
+    }
+    memcpy(data->tiles, legacy.tiles, sizeof(data->tiles));
+    memcpy(data->sprites, legacy.sprites, sizeof(data->sprites));
+    if (level->version == 1) {
+        fill_pvs(data);
+    } else {
+        widen_pvs(&legacy, data);
+    }
+    if (level->version <= 2) {
+        fill_floors(data);
+    } else {
+        memcpy(data->floors, legacy.floors, sizeof(data->floors));
+        memcpy(data->ceilings, legacy.ceilings, sizeof(data->ceilings));
+    }
+}
+
+static void read_chunk(const level_t* level, int index, chunk_data_t* data) {
+    if (level->chunks != NULL) {
+        memcpy(data, &level->chunks[index], sizeof(chunk_data_t));
+        return;
+    }
+    if (level->version < WORLD_VERSION) {
+        read_legacy_chunk(level, index, data);
+        return;
+    }
+    off_t _offset = sizeof(world_header_t) + (off_t)index * sizeof(chunk_data_t);
+    if (pread(level->fd, data, sizeof(chunk_data_t), _offset) != sizeof(chunk_data_t)) {
+        fail_chunk(index, data);
+    }
+}
+
+static level_t* level_new(int width, int height) {
+    level_t* level = calloc(1, sizeof(level_t));
+    if (level == NULL) {
+        return NULL;
+    }
+    level->width = width;
+    level->height = height;
+    level->chunk_cols = (width + CHUNK_SIZE - 1) / CHUNK_SIZE;
+    level->chunk_rows = (height + CHUNK_SIZE - 1) / CHUNK_SIZE;
+    level->version = WORLD_VERSION;
+    level->fd = -1;
+    return level;
+}
+
+/// Opens a world file written by level_write. Only the header is read
+/// here, the chunks are paged in by the worlds as their player gets close.
+level_t* level_open(const char* path) {
+    int _fd = open(path, O_RDONLY);
+    if (_fd < 0) {
+        fprintf(stderr, "Error at world loading: cannot open %s\n", path);
+        return NULL;
+    }
+    world_header_t header;
+    if (pread(_fd, &header, sizeof(header), 0) != sizeof(header) ||
+        memcmp(header.magic, WORLD_MAGIC, sizeof(WORLD_MAGIC)) != 0 ||
+        header.version < 1 || header.version > WORLD_VERSION || header.chunk_size != CHUNK_SIZE ||
+        header.width == 0 || header.height == 0) {
+        fprintf(stderr, "Error at world loading: bad header in %s\n", path);
+        close(_fd);
+        return NULL;
+    }
+    level_t* level = level_new(header.width, header.height);
+    if (level == NULL) {
+        close(_fd);
+        return NULL;
+    }
+    level->version = header.version;
+    level->fd = _fd;
+    return level;
+}
+
+static char* read_text(const char* path, size_t* size) {
+    FILE* file = fopen(path, "rb");
+    if (file == NULL) {
+        fprintf(stderr, "Error at world loading: cannot open %s\n", path);
+        return NULL;
+    }
+    fseek(file, 0, SEEK_END);
+    long _size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    char* text = malloc(_size + 1);
+    if (text != NULL && fread(text, 1, _size, file) == (size_t)_size) {
+        text[_size] = '\0';
+        *size = _size;
+    } else {
+        free(text);
+        text = NULL;
+    }
+    fclose(file);
+    return text;
+}
+
+/// Calls visit on every character of the non-empty lines of a text map
+static void each_map_char(char* text, void (*visit)(level_t*, int, int, char, size_t),
+                          level_t* level, size_t layer) {
+    int _row = 0;
+    char* _save = NULL;
+    for (char* line = strtok_r(text, "\n", &_save); line != NULL;
+         line = strtok_r(NULL, "\n", &_save)) {
+        for (int col = 0; line[col] != '\0' && line[col] != '\r'; col++) {
+            visit(level, col, _row, line[col], layer);
+        }
+        _row++;
+    }
+}
+
+static void measure_char(level_t* level, int col, int row, char c, size_t layer) {
+    (void)c;
+    (void)layer;
+    level->width = col + 1 > level->width ? col + 1 : level->width;
+    level->height = row + 1 > level->height ? row + 1 : level->height;
+}
+
+static void store_char(level_t* level, int col, int row, char c, size_t layer) {
+    if (col >= level->width || row >= level->height) {
+        return; // The tiles decided the size of the world
+    }
+    chunk_data_t* chunk =
+        &level->chunks[(row / CHUNK_SIZE) * level->chunk_cols + col / CHUNK_SIZE];
+    char* _cell = (char*)chunk + layer;
+    _cell[(row % CHUNK_SIZE) * CHUNK_SIZE + col % CHUNK_SIZE] = c;
+}
+
+/// Floor and ceiling maps name atlas slots 0 to 9 by a digit, and the
+/// following ones by a lowercase letter; anything else keeps the default
+static void store_slot(level_t* level, int col, int row, char c, size_t layer) {
+    if (c >= '0' && c <= '9') {
+        store_char(level, col, row, c - '0', layer);
+    } else if (c >= 'a' && c <= 'z') {
+        store_char(level, col, row, 10 + c - 'a', layer);
+    }
+}
+
+// -------------------------
+// Potentially visible sets
+// -------------------------
+
+// Rays cast from each sample point of a tile: a tile MAX_RAY_STEPS away
+// still spans about two of them
+#define PVS_RAYS 360
+
+static char memory_tile(const level_t* level, int col, int row) {
+    if (col < 0 || col >= level->width || row < 0 || row >= level->height) {
+        return WORLD_BOUNDARY;
+    }
+    chunk_data_t* chunk =
+        &level->chunks[(row / CHUNK_SIZE) * level->chunk_cols + col / CHUNK_SIZE];
+    return chunk->tiles[row % CHUNK_SIZE][col % CHUNK_SIZE];
+}
+
+/// Doors count as open: they can be, whenever the player looks
+static bool pvs_blocks(char tile) { return tile != '.' && tile != 'p'; }
+
+/// Adds the cell of (col, row) to pvs, the PVS of the cell of (from_col,
+/// from_row)
+static void pvs_add(uint32_t* pvs, int from_col, int from_row, int col, int row) {
+    pvs_set(pvs, col / PVS_CELL - from_col / PVS_CELL, row / PVS_CELL - from_row / PVS_CELL);
+}
+
+/// Cells of the tile and of its eight neighbours, which only differ from
+/// its own on the edges of a cell
+static void pvs_neighbours(const level_t* level, uint32_t* pvs, int from_col, int from_row,
+                           int col, int row) {
+    int _in_col = col % PVS_CELL, _in_row = row % PVS_CELL;
+    int _dx = _in_col == 0 && col > 0                              ? -1
+              : _in_col == PVS_CELL - 1 && col < level->width - 1 ? 1
+                                                                   : 0;
+    int _dy = _in_row == 0 && row > 0                               ? -1
+              : _in_row == PVS_CELL - 1 && row < level->height - 1 ? 1
+                                                                    : 0;
+    pvs_add(pvs, from_col, from_row, col, row);
+    if (_dx != 0) {
+        pvs_add(pvs, from_col, from_row, col + _dx, row);
+    }
+    if (_dy != 0) {
+        pvs_add(pvs, from_col, from_row, col, row + _dy);
+    }
+    if (_dx != 0 && _dy != 0) {
+        pvs_add(pvs, from_col, from_row, col + _dx, row + _dy);
+    }
+}
+
+/// Adds the cells of the tiles a ray goes through from (x, y), in tiles,
+/// and of their neighbours, until it hits a wall or gives up as the
+/// renderer does
+static void pvs_ray(const level_t* level, uint32_t* pvs, int col, int row, double x, double y,
+                    double angle) {
+    double _dx = cos(angle), _dy = sin(angle);
+    int _step_col = _dx > 0 ? 1 : -1;
+    int _step_row = _dy > 0 ? 1 : -1;
+    double _delta_x = _dx != 0 ? fabs(1 / _dx) : INFINITY;
+    double _delta_y = _dy != 0 ? fabs(1 / _dy) : INFINITY;
+    double _next_x = (_dx > 0 ? col + 1 - x : x - col) * _delta_x;
+    double _next_y = (_dy > 0 ? row + 1 - y : y - row) * _delta_y;
+    int _col = col, _row = row;
+
+    for (int i = 0; i < MAX_RAY_STEPS; i++) {
+        if (_next_x < _next_y) {
+            _col += _step_col;
+            _next_x += _delta_x;
+        } else {
+            _row += _step_row;
+            _next_y += _delta_y;
+        }
+        if (pvs_blocks(memory_tile(level, _col, _row))) {
+            break;
+        }
+        pvs_neighbours(level, pvs, col, row, _col, _row);
+    }
+}
+
+/// Computes the PVS of every cell of a level held in memory: what any of
+/// its open tiles sees, casting rays all around from a few points of the
+/// tile. Two rays are never a tile apart, and the neighbours of every tile
+/// they cross are seen too: cells only glimpsed between two rays are kept,
+/// walls hide the rest.
+static void build_pvs(level_t* level) {
+    const double _samples[] = {0.02, 0.5, 0.98};
+    const int _nb_samples = sizeof(_samples) / sizeof(_samples[0]);
+    size_t _chunks = level->chunk_cols * level->chunk_rows;
+
+    for (size_t i = 0; i < _chunks; i++) {
+        memset(level->chunks[i].pvs, 0, sizeof(level->chunks[i].pvs));
+    }
+    for (int row = 0; row < level->height; row++) {
+        for (int col = 0; col < level->width; col++) {
+            if (pvs_blocks(memory_tile(level, col, row))) {
+                continue;
+            }
+            chunk_data_t* chunk =
+                &level->chunks[(row / CHUNK_SIZE) * level->chunk_cols + col / CHUNK_SIZE];
+            uint32_t* _pvs = chunk->pvs[row % CHUNK_SIZE / PVS_CELL][col % CHUNK_SIZE / PVS_CELL];
+            pvs_add(_pvs, col, row, col, row);
+            for (int sy = 0; sy < _nb_samples; sy++) {
+                for (int sx = 0; sx < _nb_samples; sx++) {
+                    for (int a = 0; a < PVS_RAYS; a++) {
+                        pvs_ray(level, _pvs, col, row, col + _samples[sx], row + _samples[sy],
+                                2 * M_PI * a / PVS_RAYS);
+                    }
+                }
+            }
+        }
+    }
+
+    // A cell without any open tile is never stood in, unless stuck in a wall
+    for (size_t i = 0; i < _chunks; i++) {
+        for (int cy = 0; cy < PVS_CELLS; cy++) {
+            for (int cx = 0; cx < PVS_CELLS; cx++) {
+                uint32_t* _pvs = level->chunks[i].pvs[cy][cx];
+                int _bit = PVS_RADIUS * PVS_SPAN + PVS_RADIUS; // The cell itself
+                if (!((_pvs[_bit / 32] >> (_bit % 32)) & 1)) {
+                    memset(_pvs, 0xff, sizeof(level->chunks[i].pvs[cy][cx]));
+                }
+            }
+        }
+    }
+}
+
+/// Builds a level from the legacy text maps (one character per tile), cut
+/// into chunks in memory. The floor and ceiling maps are optional: without
+/// them (NULL or no such file), every tile gets the default slots.
+level_t* level_open_text(const char* map_path, const char* sprite_path,
+                         const char* floor_path, const char* ceiling_path) {
+    size_t _map_size, _sprite_size, _floor_size, _ceiling_size;
+    char* _map = read_text(map_path, &_map_size);
+    char* _sprites = read_text(sprite_path, &_sprite_size);
+    char* _floors = NULL;
+    char* _ceilings = NULL;
+    level_t* level = NULL;
+    if (_map == NULL || _sprites == NULL) {
+        goto Quit;
+    }
+    if (floor_path != NULL && access(floor_path, R_OK) == 0) {
+        _floors = read_text(floor_path, &_floor_size);
+    }
+    if (ceiling_path != NULL && access(ceiling_path, R_OK) == 0) {
+        _ceilings = read_text(ceiling_path, &_ceiling_size);
+    }
+
+    // The tiles decide the size of the level, strtok_r needs its own copy
+    level_t _size = {0};
+    char* _copy = strdup(_map);
+    if (_copy != NULL) {
+        each_map_char(_copy, measure_char, &_size, 0);
+        free(_copy);
+    }
+    if (_size.width == 0) {
+        fprintf(stderr, "Error at world loading: %s is empty\n", map_path);
+        goto Quit;
+    }
+    level = level_new(_size.width, _size.height);
+    if (level == NULL) {
+        goto Quit;
+    }
+
+    size_t _chunks = level->chunk_cols * level->chunk_rows;
+    level->chunks = malloc(_chunks * sizeof(chunk_data_t));
+    if (level->chunks == NULL) {
+        fprintf(stderr, "Error at world loading: %zu chunks are too many\n", _chunks);
+        level_close(level);
+        level = NULL;
+        goto Quit;
+    }
+    for (size_t i = 0; i < _chunks; i++) {
+        memset(level->chunks[i].tiles, WORLD_BOUNDARY, sizeof(level->chunks[i].tiles));
+        memset(level->chunks[i].sprites, '.', sizeof(level->chunks[i].sprites));
+        fill_pvs(&level->chunks[i]);
+        fill_floors(&level->chunks[i]);
+    }
+    each_map_char(_map, store_char, level, offsetof(chunk_data_t, tiles));
+    each_map_char(_sprites, store_char, level, offsetof(chunk_data_t, sprites));
+    if (_floors != NULL) {
+        each_map_char(_floors, store_slot, level, offsetof(chunk_data_t, floors));
+    }
+    if (_ceilings != NULL) {
+        each_map_char(_ceilings, store_slot, level, offsetof(chunk_data_t, ceilings));
+    }
+    build_pvs(level);
+
+Quit:
+    free(_map);
+    free(_sprites);
+    free(_floors);
+    free(_ceilings);
+    return level;
+}
+
+/// Writes a level built by level_open_text as a chunked world file
+bool level_write(const level_t* level, const char* path) {
+    if (level->chunks == NULL) {
+        return false;
+    }
+    FILE* file = fopen(path, "wb");
+    if (file == NULL) {
+        fprintf(stderr, "Error at world writing: cannot open %s\n", path);
+        return false;
+    }
+    world_header_t header = {{0}, WORLD_VERSION, level->width, level->height, CHUNK_SIZE};
+    memcpy(header.magic, WORLD_MAGIC, sizeof(WORLD_MAGIC));
+    size_t _chunks = level->chunk_cols * level->chunk_rows;
+    bool ok = fwrite(&header, sizeof(header), 1, file) == 1 &&
+              fwrite(level->chunks, sizeof(chunk_data_t), _chunks, file) == _chunks;
+    if (fclose(file) != 0 || !ok) {
+        fprintf(stderr, "Error at world writing: cannot write %s\n", path);
+        return false;
+    }
+    return true;
+}
+
+/// Frees a level no world plays anymore
+void level_close(level_t* level) {
+    if (level == NULL) {
+        return;
+    }
+    if (level->fd >= 0) {
+        close(level->fd);
+    }
+    free(level->chunks);
+    free(level);
+}
+
+// -------------------------
+// Worlds
+// -------------------------
+
+// Loader threads, shared by every world playing a world file: a queue of
+// chunks to read, whichever world they belong to
+static pthread_t loaders[CHUNK_LOADERS];
+static int loader_count = 0;
+static pthread_mutex_t loader_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t loader_wake = PTHREAD_COND_INITIALIZER; // New request or stop
+static chunk_t* request_head = NULL;
+static chunk_t* request_tail = NULL;
+static bool loaders_stopping = false;
+
+static void* chunk_loader(void* arg) {
+    (void)arg;
+    pthread_mutex_lock(&loader_lock);
+    for (;;) {
+        while (request_head == NULL && !loaders_stopping) {
+            pthread_cond_wait(&loader_wake, &loader_lock);
+        }
+        if (request_head == NULL) {
+            break; // Stopping, and nothing left to load
+        }
+        chunk_t* chunk = request_head;
+        request_head = chunk->next_request;
+        request_tail = request_head == NULL ? NULL : request_tail;
+        pthread_mutex_unlock(&loader_lock);
+
+        world_t* owner = chunk->owner;
+        read_chunk(owner->level, chunk->index, &chunk->data);
+        pthread_mutex_lock(&owner->lock);
+        atomic_store(&chunk->state, CHUNK_READY);
+        pthread_cond_broadcast(&owner->loaded);
+        pthread_mutex_unlock(&owner->lock);
+
+        pthread_mutex_lock(&loader_lock);
+    }
+    pthread_mutex_unlock(&loader_lock);
+    return NULL;
+}
+
+/// Starts the loader threads the first time a world file is played. False
+/// if none could start: chunks are then read on the spot.
+static bool start_loaders() {
+    pthread_mutex_lock(&loader_lock);
+    if (loader_count == 0) {
+        while (loader_count < CHUNK_LOADERS &&
+               pthread_create(&loaders[loader_count], NULL, chunk_loader, NULL) == 0) {
+            loader_count++;
+        }
+        if (loader_count == 0) {
+            fprintf(stderr, "Error at world loading: chunks will be loaded synchronously\n");
+        }
+    }
+    bool _started = loader_count > 0;
+    pthread_mutex_unlock(&loader_lock);
+    return _started;
+}
+
+/// Stops the loader threads, once every world is closed
+void world_stop_loaders() {
+    pthread_mutex_lock(&loader_lock);
+    loaders_stopping = true;
+    pthread_cond_broadcast(&loader_wake);
+    pthread_mutex_unlock(&loader_lock);
+    for (int i = 0; i < loader_count; i++) {
+        pthread_join(loaders[i], NULL);
+    }
+    loader_count = 0;
+    loaders_stopping = false;
+}
+
+/// Makes the current world play the level from scratch: nothing resident,
+/// no prop spawned. Levels in memory are paged in on the spot, world files
+/// by the loader threads.
+bool world_open(const level_t* level) {
+    world_close();
+    *world = (world_t){level->width, level->height, level->chunk_cols, level->chunk_rows};
+    world->level = level;
+    world_revise();
+    pthread_mutex_init(&world->lock, NULL);
+    pthread_cond_init(&world->loaded, NULL);
+    int _chunks = world->chunk_cols * world->chunk_rows;
+
+    world->directory = malloc(_chunks * sizeof(short));
+    world->spawned = calloc(_chunks, sizeof(bool));
+    world->prop_links = malloc(MAX_PROPS * sizeof(short));
+    if (world->directory == NULL || world->spawned == NULL || world->prop_links == NULL) {
+        fprintf(stderr, "Error at world loading: %d chunks are too many\n", _chunks);
+        world_close();
+        return false;
+    }
+    for (int i = 0; i < _chunks; i++) {
+        world->directory[i] = -1;
+    }
+    for (int i = 0; i < CHUNK_CACHE_SIZE; i++) {
+        world->cache[i].index = -1;
+        atomic_init(&world->cache[i].state, CHUNK_FREE);
+    }
+    world->streamed = level->chunks == NULL && start_loaders();
+    return true;
+}
+
+// -------------------------
+// Cache
+// -------------------------
+
+static void wait_ready(chunk_t* chunk) {
+    pthread_mutex_lock(&world->lock);
+    while (atomic_load(&chunk->state) != CHUNK_READY) {
+        pthread_cond_wait(&world->loaded, &world->lock);
+    }
+    pthread_mutex_unlock(&world->lock);
+}
+
+/// Chunks around the player are kept over any other, then the least
+/// recently read go first: a frame paging in more chunks than the cache
+/// holds evicts its own reads, never what the next frame draws
+static bool evict_before(const chunk_t* a, const chunk_t* b) {
+    bool _a_near = a->prefetched == world->clock, _b_near = b->prefetched == world->clock;
+    return _a_near != _b_near ? _b_near : a->last_used < b->last_used;
+}
+
+/// Frees the ready slot to evict first (if no slot is free yet)
+static chunk_t* acquire_slot() {
+    for (;;) {
+        chunk_t* victim = NULL;
+        chunk_t* loading = NULL;
+        for (int i = 0; i < CHUNK_CACHE_SIZE; i++) {
+            chunk_t* chunk = &world->cache[i];
+            int _state = atomic_load(&chunk->state);
+            if (_state == CHUNK_FREE) {
+                return chunk;
+            }
+            if (_state == CHUNK_LOADING) {
+                loading = chunk;
+            } else if (victim == NULL || evict_before(chunk, victim)) {
+                victim = chunk;
+            }
+        }
+        if (victim != NULL) {
+            world->despawn_due |= world->spawned[victim->index];
+            world->directory[victim->index] = -1;
+            victim->index = -1;
+            atomic_store(&victim->state, CHUNK_FREE);
+            if (world->last_chunk == victim) {
+                world->last_chunk = NULL;
+            }
+            return victim;
+        }
+        // Every slot is being loaded: wait for one of them
+        wait_ready(loading);
+    }
+}
+
+static chunk_t* page_in(int index, bool async) {
+    chunk_t* chunk = acquire_slot();
+    chunk->index = index;
+    chunk->solidity_ready = false;
+    chunk->last_used = ++world->ticks;
+    chunk->prefetched = 0;
+    world->directory[index] = chunk - world->cache;
+    world->loads++;
+
+    if (!async || !world->streamed) {
+        read_chunk(world->level, index, &chunk->data);
+        atomic_store(&chunk->state, CHUNK_READY);
+        return chunk;
+    }
+    atomic_store(&chunk->state, CHUNK_LOADING);
+    chunk->owner = world;
+    chunk->next_request = NULL;
+    pthread_mutex_lock(&loader_lock);
+    *(request_tail != NULL ? &request_tail->next_request : &request_head) = chunk;
+    request_tail = chunk;
+    pthread_cond_signal(&loader_wake);
+    pthread_mutex_unlock(&loader_lock);
+    return chunk;
+}
+
+static void set_chunk_bit(uint32_t* plane, int x, int y, bool value) {
+    if (value) {
+        plane[y] |= 1u << x;
+    } else {
+        plane[y] &= ~(1u << x);
+    }
+}
+
+/// Solidity of one tile of a chunk, from its code, its door and the props
+static void build_tile_solidity(chunk_t* chunk, int col, int row) {
+    int _x = col % CHUNK_SIZE, _y = row % CHUNK_SIZE;
+    char _tile = chunk->data.tiles[_y][_x];
+    door_t* _door = _tile == 'p' ? door_find(col, row) : NULL;
+    bool _open = _door != NULL && _door->open == TILE_WIDTH;
+
+    set_chunk_bit(chunk->opaque, _x, _y, _tile != '.');
+    set_chunk_bit(chunk->solid, _x, _y, _tile != '.' && !_open);
+    set_chunk_bit(chunk->occupied, _x, _y, prop_blocks(col, row));
+}
+
+static void build_chunk_solidity(chunk_t* chunk) {
+    int _col = chunk->index % world->chunk_cols * CHUNK_SIZE;
+    int _row = chunk->index / world->chunk_cols * CHUNK_SIZE;
+
+    for (int y = 0; y < CHUNK_SIZE; y++) {
+        chunk->opaque[y] = chunk->solid[y] = chunk->occupied[y] = 0;
+        for (int x = 0; x < CHUNK_SIZE; x++) {
+            char _tile = chunk->data.tiles[y][x];
+            if (_tile == 'p') {
+                build_tile_solidity(chunk, _col + x, _row + y);
+            } else if (_tile != '.') {
+                chunk->opaque[y] |= 1u << x;
+                chunk->solid[y] |= 1u << x;
+            }
+        }
+    }
+    // Props are few: mark their tiles rather than looking each tile up, and
+    // link them in their cells backwards so each cell lists them by index
+    memset(chunk->cell_props, -1, sizeof(chunk->cell_props));
+    for (int i = prop_set->prop_number - 1; i >= 0; i--) {
+        int _x = (int)prop_set->props[i].position.x / TILE_WIDTH - _col;
+        int _y = (int)prop_set->props[i].position.y / TILE_HEIGHT - _row;
+        if (_x < 0 || _x >= CHUNK_SIZE || _y < 0 || _y >= CHUNK_SIZE) {
+            continue;
+        }
+        if (prop_collides(&prop_set->props[i])) {
+            chunk->occupied[_y] |= 1u << _x;
+        }
+        short* _cell = &chunk->cell_props[_y / PVS_CELL][_x / PVS_CELL];
+        world->prop_links[i] = *_cell;
+        *_cell = i;
+    }
+    chunk->solidity_ready = true;
+}
+
+/// True if the prop stands in the PVS cell of the tile
+static bool in_cell(const prop_t* prop, int col, int row) {
+    return (int)prop->position.x / TILE_WIDTH / PVS_CELL == col / PVS_CELL &&
+           (int)prop->position.y / TILE_HEIGHT / PVS_CELL == row / PVS_CELL;
+}
+
+/// Lists the props standing in the PVS cell of the tile again, by index
+static void link_cell(chunk_t* chunk, int col, int row) {
+    short* _cell = &chunk->cell_props[row % CHUNK_SIZE / PVS_CELL][col % CHUNK_SIZE / PVS_CELL];
+    *_cell = -1;
+    for (int i = prop_set->prop_number - 1; i >= 0; i--) {
+        if (in_cell(&prop_set->props[i], col, row)) {
+            world->prop_links[i] = *_cell;
+            *_cell = i;
+        }
+    }
+}
+
+/// Refreshes the solidity of a tile after its door or one of its props
+/// changed (door fully opened or closing, prop killed, enemy moved), and
+/// the props of its PVS cell
+void world_update_tile(int col, int row) {
+    if (col < 0 || col >= world->width || row < 0 || row >= world->height) {
+        return;
+    }
+    int _index = (row / CHUNK_SIZE) * world->chunk_cols + col / CHUNK_SIZE;
+    if (world->directory[_index] < 0) {
+        return; // Built from scratch when paged in again
+    }
+    chunk_t* chunk = &world->cache[world->directory[_index]];
+    if (atomic_load(&chunk->state) == CHUNK_READY && chunk->solidity_ready) {
+        build_tile_solidity(chunk, col, row);
+        link_cell(chunk, col, row);
+    }
+}
+
+/// Rebuilds the solidity of every resident chunk on its next read, after
+/// the props and the doors were all replaced (a snapshot restored)
+void world_reset_solidity() {
+    for (int i = 0; i < CHUNK_CACHE_SIZE; i++) {
+        world->cache[i].solidity_ready = false;
+    }
+    world->last_chunk = NULL;
+}
+
+/// Gives the walls of the current world a revision no world ever had: a
+/// scene drawn at a revision stays valid in any world at that revision,
+/// snapshots restored included
+void world_revise() {
+    static atomic_ulong revisions = 0;
+    world->revision = atomic_fetch_add(&revisions, 1) + 1;
+}
+
+/// Pages in every chunk of the tiles between (min_col, min_row) and
+/// (max_col, max_row), then builds the solidity of every resident chunk for
+/// world_peek_solid. What is peeked in the box does not depend on how far
+/// the loader got; the box must fit in the cache.
+void world_prepare_peek(int min_col, int min_row, int max_col, int max_row) {
+    int _first_col = (min_col < 0 ? 0 : min_col) / CHUNK_SIZE;
+    int _first_row = (min_row < 0 ? 0 : min_row) / CHUNK_SIZE;
+    int _last_col = (max_col >= world->width ? world->width - 1 : max_col) / CHUNK_SIZE;
+    int _last_row = (max_row >= world->height ? world->height - 1 : max_row) / CHUNK_SIZE;
+    for (int row = _first_row; max_row >= 0 && row <= _last_row; row++) {
+        for (int col = _first_col; max_col >= 0 && col <= _last_col; col++) {
+            world_chunk(col * CHUNK_SIZE, row * CHUNK_SIZE);
+        }
+    }
+    for (int i = 0; i < CHUNK_CACHE_SIZE; i++) {
+        if (atomic_load(&world->cache[i].state) == CHUNK_READY && !world->cache[i].solidity_ready) {
+            build_chunk_solidity(&world->cache[i]);
+        }
+    }
+}
+
+/// world_solid for any thread, as long as the game thread leaves the world
+/// alone meanwhile: nothing is paged in, the tiles of chunks not resident
+/// (or resident since world_prepare_peek) are solid
+bool world_peek_solid(int col, int row) {
+    if (col < 0 || col >= world->width || row < 0 || row >= world->height) {
+        return true;
+    }
+    short _slot = world->directory[(row / CHUNK_SIZE) * world->chunk_cols + col / CHUNK_SIZE];
+    if (_slot < 0) {
+        return true;
+    }
+    chunk_t* chunk = &world->cache[_slot];
+    if (atomic_load(&chunk->state) != CHUNK_READY || !chunk->solidity_ready) {
+        return true;
+    }
+    return chunk_bit(chunk->solid, col, row);
+}
+
+/// Writes the indices of the props standing in the PVS cells the tile may
+/// see into props, cell by cell, each cell's by index, and returns their
+/// number, MAX_PROPS at most. Outside of the world, every prop is seen.
+/// Only the chunk of the tile may be paged in.
+int world_visible_props(int col, int row, int* props) {
+    int _count = 0;
+    if (col < 0 || col >= world->width || row < 0 || row >= world->height) {
+        for (; _count < prop_set->prop_number; _count++) {
+            props[_count] = _count;
+        }
+        return _count;
+    }
+
+    const uint32_t* _pvs =
+        world_chunk(col, row)->data.pvs[row % CHUNK_SIZE / PVS_CELL][col % CHUNK_SIZE / PVS_CELL];
+    int _first_col = col / PVS_CELL - PVS_RADIUS, _first_row = row / PVS_CELL - PVS_RADIUS;
+    for (int b = 0; b < PVS_SPAN * PVS_SPAN; b++) {
+        if (!((_pvs[b / 32] >> (b % 32)) & 1)) {
+            continue;
+        }
+        int _col = (_first_col + b % PVS_SPAN) * PVS_CELL;
+        int _row = (_first_row + b / PVS_SPAN) * PVS_CELL;
+        if (_col < 0 || _col >= world->width || _row < 0 || _row >= world->height) {
+            continue;
+        }
+        short _slot = world->directory[_row / CHUNK_SIZE * world->chunk_cols + _col / CHUNK_SIZE];
+        if (_slot < 0 || atomic_load(&world->cache[_slot].state) != CHUNK_READY) {
+            // Not waited for: only the props kept from an earlier visit
+            // can stand there, looked for one by one
+            for (int i = 0; i < prop_set->prop_number && _count < MAX_PROPS; i++) {
+                if (in_cell(&prop_set->props[i], _col, _row)) {
+                    props[_count++] = i;
+                }
+            }
+            continue;
+        }
+        chunk_t* chunk = &world->cache[_slot];
+        if (!chunk->solidity_ready) {
+            build_chunk_solidity(chunk);
+        }
+        short i = chunk->cell_props[_row % CHUNK_SIZE / PVS_CELL][_col % CHUNK_SIZE / PVS_CELL];
+        for (; i >= 0 && _count < MAX_PROPS; i = world->prop_links[i]) {
+            props[_count++] = i;
+        }
+    }
+    return _count;
+}
+
+/// Data of the chunk holding the tile, NULL outside of the world or if the
+/// chunk is not resident and ready: nothing is paged in
+const chunk_data_t* world_resident_chunk(int col, int row) {
+    if (col < 0 || col >= world->width || row < 0 || row >= world->height) {
+        return NULL;
+    }
+    int _index = (row / CHUNK_SIZE) * world->chunk_cols + col / CHUNK_SIZE;
+    if (world->last_chunk != NULL && world->last_chunk->index == _index) {
+        return &world->last_chunk->data;
+    }
+    short _slot = world->directory[_index];
+    if (_slot < 0 || atomic_load(&world->cache[_slot].state) != CHUNK_READY) {
+        return NULL;
+    }
+    return &world->cache[_slot].data;
+}
+
+/// Resident chunk holding the tile, paged in on the spot if the prefetch
+/// did not see it coming
+chunk_t* world_chunk(int col, int row) {
+    int _index = (row / CHUNK_SIZE) * world->chunk_cols + col / CHUNK_SIZE;
+    if (world->last_chunk != NULL && world->last_chunk->index == _index) {
+        return world->last_chunk;
+    }
+
+    chunk_t* chunk;
+    if (world->directory[_index] < 0) {
+        world->stalls++;
+        chunk = page_in(_index, false);
+    } else {
+        chunk = &world->cache[world->directory[_index]];
+        if (atomic_load(&chunk->state) != CHUNK_READY) {
+            world->stalls++;
+            wait_ready(chunk);
+        }
+    }
+    if (!chunk->solidity_ready) {
+        build_chunk_solidity(chunk);
+    }
+    chunk->last_used = ++world->ticks;
+    world->last_chunk = chunk;
+    return chunk;
+}
+
+/// Drops the idle props and the closed doors of the chunks evicted since the
+/// last call, which are spawned again with their chunk: only what changed
+/// stays in the tables. Evictions happen in the middle of a frame, this
+/// waits for the next spawn so the props never move under the game's feet.
+static void despawn_evicted_chunks() {
+    if (!world->despawn_due) {
+        return;
+    }
+    world->despawn_due = false;
+    int _props = prop_set->prop_number;
+    for (int i = 0; i < world->chunk_cols * world->chunk_rows; i++) {
+        if (world->spawned[i] && world->directory[i] < 0) {
+            world->spawned[i] = false;
+            despawn_props(i % world->chunk_cols * CHUNK_SIZE, i / world->chunk_cols * CHUNK_SIZE);
+            world->spawns++;
+            forget_doors(i % world->chunk_cols * CHUNK_SIZE, i / world->chunk_cols * CHUNK_SIZE);
+        }
+    }
+    if (prop_set->prop_number != _props) {
+        world_reset_solidity(); // The props kept moved down the table: link them again
+    }
+}
+
+static void spawn_ready_chunks() {
+    despawn_evicted_chunks();
+    for (int i = 0; i < CHUNK_CACHE_SIZE; i++) {
+        chunk_t* chunk = &world->cache[i];
+        if (atomic_load(&chunk->state) == CHUNK_READY && !world->spawned[chunk->index]) {
+            world->spawned[chunk->index] = true;
+            spawn_props(chunk->index % world->chunk_cols * CHUNK_SIZE,
+                        chunk->index / world->chunk_cols * CHUNK_SIZE, &chunk->data);
+            chunk->solidity_ready = false; // The new props occupy their tiles
+            world->spawns++;
+            world->last_chunk = NULL;
+        }
+    }
+}
+
+/// Queues the chunks around pos for the loader threads, keeping the resident
+/// ones over any other, without spawning anything: for a world whose props
+/// come from a snapshot. Called once per frame, it also ages the cache.
+void world_follow(vector_t pos) {
+    world->clock++;
+    world->last_chunk = NULL;
+
+    int _col = (int)pos.x / TILE_WIDTH / CHUNK_SIZE;
+    int _row = (int)pos.y / TILE_HEIGHT / CHUNK_SIZE;
+    for (int r = _row - CHUNK_PREFETCH_RADIUS; r <= _row + CHUNK_PREFETCH_RADIUS; r++) {
+        for (int c = _col - CHUNK_PREFETCH_RADIUS; c <= _col + CHUNK_PREFETCH_RADIUS; c++) {
+            if (c < 0 || c >= world->chunk_cols || r < 0 || r >= world->chunk_rows) {
+                continue;
+            }
+            int _index = r * world->chunk_cols + c;
+            short _slot = world->directory[_index];
+            chunk_t* chunk = _slot < 0 ? page_in(_index, true) : &world->cache[_slot];
+            chunk->last_used = ++world->ticks;
+            chunk->prefetched = world->clock;
+        }
+    }
+}
+
+/// world_follow, then brings the props of the chunks loaded since the last
+/// call into the game. Called once per frame.
+void world_prefetch(vector_t pos) {
+    world_follow(pos);
+    spawn_ready_chunks();
+}
+
+/// Waits for every queued chunk, e.g. before the first frame
+void world_sync() {
+    for (int i = 0; i < CHUNK_CACHE_SIZE; i++) {
+        if (atomic_load(&world->cache[i].state) == CHUNK_LOADING) {
+            wait_ready(&world->cache[i]);
+        }
+    }
+    spawn_ready_chunks();
+}
+
+/// Withdraws the chunks of the current world from the loader threads and
+/// forgets them. The level stays open.
+void world_close() {
+    if (world->level == NULL) {
+        return;
+    }
+    if (world->streamed) {
+        // The requests no loader took yet are withdrawn, the chunks being
+        // read are waited for
+        pthread_mutex_lock(&loader_lock);
+        request_tail = NULL;
+        for (chunk_t** link = &request_head; *link != NULL;) {
+            if ((*link)->owner == world) {
+                atomic_store(&(*link)->state, CHUNK_FREE);
+                *link = (*link)->next_request;
+            } else {
+                request_tail = *link;
+                link = &(*link)->next_request;
+            }
+        }
+        pthread_mutex_unlock(&loader_lock);
+        for (int i = 0; i < CHUNK_CACHE_SIZE; i++) {
+            if (atomic_load(&world->cache[i].state) == CHUNK_LOADING) {
+                wait_ready(&world->cache[i]);
+            }
+        }
+        world->streamed = false;
+    }
+    pthread_mutex_destroy(&world->lock);
+    pthread_cond_destroy(&world->loaded);
+    free(world->directory);
+    free(world->spawned);
+    free(world->prop_links);
+    world->directory = NULL;
+    world->spawned = NULL;
+    world->prop_links = NULL;
+    world->last_chunk = NULL;
+    world->level = NULL;
+}
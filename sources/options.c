@@ -0,0 +1,111 @@
+#include "options.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+options_t options = {
+    .asset_root = "..",
+    .bundle_path = NULL,
+    .bundle_output = NULL,
+    .asset_workers = 0,
+    .backend = BACKEND_SDL,
+    .software_renderer = false,
+    .max_frames = 0,
+    .uncapped = false,
+    .capture_path = NULL,
+    .record_path = NULL,
+    .replay_path = NULL,
+    .latency = false,
+    .world_path = NULL,
+    .world_output = NULL,
+};
+
+void print_usage(const char* program) {
+    fprintf(stderr,
+            "Usage: %s [options]\n"
+            "  --assets <dir>         directory holding the game assets (default: ..)\n"
+            "  --bundle <file>        load every asset from a prebuilt bundle\n"
+            "  --build-bundle <file>  decode the assets, write them as a bundle and exit\n"
+            "  --asset-workers <n>    number of decoding threads (default: one per CPU)\n"
+            "  --backend <name>       sdl (default), geometry, software or memory\n"
+            "  --software-renderer    use the SDL software renderer\n"
+            "  --frames <n>           quit after n frames\n"
+            "  --uncapped             do not limit the framerate to 60 FPS\n"
+            "  --capture <file>       record the frames as a .y4m or .ppm stream\n"
+            "  --record <file>        log the player input\n"
+            "  --replay <file>        replay a logged input, then quit\n"
+            "  --latency              report the input to present latency on exit\n"
+            "  --world <file>         stream the map from a chunked world file\n"
+            "  --build-world <file>   write the text maps as a chunked world and exit\n",
+            program);
+}
+
+/// Fills the global options from the command line, returns false on error
+bool parse_options(int argc, char** argv) {
+    for (int i = 1; i < argc; i++) {
+        const char* arg = argv[i];
+        const char* value = i + 1 < argc ? argv[i + 1] : NULL;
+
+        if (!strcmp(arg, "--help") || !strcmp(arg, "-h")) {
+            return false;
+        }
+
+        // Flags
+        if (!strcmp(arg, "--software-renderer")) {
+            options.software_renderer = true;
+            continue;
+        } else if (!strcmp(arg, "--uncapped")) {
+            options.uncapped = true;
+            continue;
+        } else if (!strcmp(arg, "--latency")) {
+            options.latency = true;
+            continue;
+        }
+
+        // Options with a value
+        if (value == NULL) {
+            fprintf(stderr, "Missing value for option %s\n", arg);
+            return false;
+        }
+
+        if (!strcmp(arg, "--assets")) {
+            options.asset_root = value;
+        } else if (!strcmp(arg, "--bundle")) {
+            options.bundle_path = value;
+        } else if (!strcmp(arg, "--build-bundle")) {
+            options.bundle_output = value;
+        } else if (!strcmp(arg, "--asset-workers")) {
+            options.asset_workers = atoi(value);
+        } else if (!strcmp(arg, "--capture")) {
+            options.capture_path = value;
+        } else if (!strcmp(arg, "--record")) {
+            options.record_path = value;
+        } else if (!strcmp(arg, "--replay")) {
+            options.replay_path = value;
+        } else if (!strcmp(arg, "--world")) {
+            options.world_path = value;
+        } else if (!strcmp(arg, "--build-world")) {
+            options.world_output = value;
+        } else if (!strcmp(arg, "--frames")) {
+            options.max_frames = atol(value);
+        } else if (!strcmp(arg, "--backend")) {
+            if (!strcmp(value, "sdl")) {
+                options.backend = BACKEND_SDL;
+            } else if (!strcmp(value, "geometry")) {
+                options.backend = BACKEND_GEOMETRY;
+            } else if (!strcmp(value, "software")) {
+                options.backend = BACKEND_SOFTWARE;
+            } else if (!strcmp(value, "memory")) {
+                options.backend = BACKEND_MEMORY;
+            } else {
+                fprintf(stderr, "Unknown backend %s\n", value);
+                return false;
+            }
+        } else {
+            fprintf(stderr, "Unknown option %s\n", arg);
+            return false;
+        }
+        i++;
+    }
+    return true;
+}
@@ -0,0 +1,252 @@
+#include "palette.h"
+#include "assets.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Colors are counted in bins of 5 bits per channel, the median cut then
+// splits the populated bins into the boxes that become the palette
+#define BIN_BITS 5
+#define BIN_NUMBER (1 << (3 * BIN_BITS))
+#define BIN_MASK ((1 << BIN_BITS) - 1)
+
+Uint32 palette[PALETTE_SIZE];
+Uint32 colormaps[2][COLORMAP_LEVELS][PALETTE_SIZE];
+
+typedef struct {
+    int start; // Range of the box in the bins array
+    int end;
+    Uint64 count; // Texels falling in the box
+} color_box_t;
+
+static Uint64 bin_count[BIN_NUMBER];
+static Uint64 bin_sum[BIN_NUMBER][3]; // Exact channel sums, for the box averages
+static Uint8 bin_index[BIN_NUMBER];   // Palette index every bin ends up in
+static Uint16 bins[BIN_NUMBER];       // Populated bins, grouped by box
+static int sort_channel;
+
+// Channel 0 is blue, 1 green and 2 red, as in the bin number
+static inline int bin_channel(int bin, int channel) {
+    return (bin >> (channel * BIN_BITS)) & BIN_MASK;
+}
+
+static inline int pixel_bin(Uint32 p) {
+    return ((p >> 9) & 0x7c00) | ((p >> 6) & 0x3e0) | ((p >> 3) & 0x1f);
+}
+
+static int compare_bins(const void* a, const void* b) {
+    return bin_channel(*(const Uint16*)a, sort_channel) -
+           bin_channel(*(const Uint16*)b, sort_channel);
+}
+
+/// Widest channel of the box, and its extent
+static int widest_channel(const color_box_t* box, int* extent) {
+    int _best = 0;
+    *extent = -1;
+    for (int c = 0; c < 3; c++) {
+        int _min = BIN_MASK, _max = 0;
+        for (int i = box->start; i < box->end; i++) {
+            int _v = bin_channel(bins[i], c);
+            _min = _v < _min ? _v : _min;
+            _max = _v > _max ? _v : _max;
+        }
+        if (_max - _min > *extent) {
+            *extent = _max - _min;
+            _best = c;
+        }
+    }
+    return _best;
+}
+
+static void each_image_texel(void (*visit)(asset_t*, int, int, Uint32)) {
+    for (int a = 0; a < ASSET_COUNT; a++) {
+        asset_t* asset = &assets[a];
+        if (asset->kind != ASSET_IMAGE) {
+            continue;
+        }
+        SDL_Surface* surface = asset->surface;
+        for (int y = 0; y < surface->h; y++) {
+            const Uint32* _row = (const Uint32*)((const char*)surface->pixels + y * surface->pitch);
+            for (int x = 0; x < surface->w; x++) {
+                visit(asset, x, y, _row[x]);
+            }
+        }
+    }
+}
+
+static void count_texel(asset_t* asset, int x, int y, Uint32 p) {
+    (void)asset;
+    (void)x;
+    (void)y;
+    if ((p >> 24) < 0x80) {
+        return;
+    }
+    int _bin = pixel_bin(p);
+    bin_count[_bin]++;
+    bin_sum[_bin][0] += p & 0xff;
+    bin_sum[_bin][1] += (p >> 8) & 0xff;
+    bin_sum[_bin][2] += (p >> 16) & 0xff;
+}
+
+static void index_texel(asset_t* asset, int x, int y, Uint32 p) {
+    Uint8 _index = (p >> 24) < 0x80 ? PALETTE_TRANSPARENT : bin_index[pixel_bin(p)];
+    asset->rows[y * asset->surface->w + x] = _index;
+    asset->columns[x * asset->surface->h + y] = _index;
+}
+
+/// Median cut of the populated bins into at most PALETTE_SIZE - 1 boxes
+/// (index 0 is kept for transparency), returns the number of boxes
+static int median_cut(color_box_t* boxes) {
+    int _bin_number = 0;
+    Uint64 _total = 0;
+    for (int b = 0; b < BIN_NUMBER; b++) {
+        if (bin_count[b] > 0) {
+            bins[_bin_number++] = b;
+            _total += bin_count[b];
+        }
+    }
+    if (_bin_number == 0) {
+        return 0;
+    }
+
+    int _box_number = 1;
+    boxes[0] = (color_box_t){0, _bin_number, _total};
+    while (_box_number < PALETTE_SIZE - 1) {
+        // Split the box with the most texels spread over the widest range
+        int _split = -1, _channel = 0;
+        Uint64 _score = 0;
+        for (int i = 0; i < _box_number; i++) {
+            if (boxes[i].end - boxes[i].start < 2) {
+                continue;
+            }
+            int _extent;
+            int _c = widest_channel(&boxes[i], &_extent);
+            if ((Uint64)_extent * boxes[i].count > _score) {
+                _score = (Uint64)_extent * boxes[i].count;
+                _split = i;
+                _channel = _c;
+            }
+        }
+        if (_split < 0) {
+            break; // Every box holds a single bin
+        }
+
+        color_box_t* box = &boxes[_split];
+        sort_channel = _channel;
+        qsort(bins + box->start, box->end - box->start, sizeof(Uint16), compare_bins);
+
+        // Cut at the median texel, leaving at least one bin on each side
+        Uint64 _half = bin_count[bins[box->start]];
+        int _cut = box->start + 1;
+        while (_cut < box->end - 1 && _half < box->count / 2) {
+            _half += bin_count[bins[_cut++]];
+        }
+        boxes[_box_number++] = (color_box_t){_cut, box->end, box->count - _half};
+        box->end = _cut;
+        box->count = _half;
+    }
+    return _box_number;
+}
+
+static void build_colormaps() {
+    for (int s = 0; s < 2; s++) {
+        for (int l = 0; l < COLORMAP_LEVELS; l++) {
+            Uint32 _light = colormap_intensity(l, s);
+            Uint32* _map = colormaps[s][l];
+            for (int i = 0; i < PALETTE_SIZE; i++) {
+                Uint32 _p = palette[i];
+                Uint32 _r = ((_p >> 16) & 0xff) * _light / 0xff;
+                Uint32 _g = ((_p >> 8) & 0xff) * _light / 0xff;
+                Uint32 _b = (_p & 0xff) * _light / 0xff;
+                _map[i] = (_p & 0xff000000) | _r << 16 | _g << 8 | _b;
+            }
+        }
+    }
+}
+
+/// Cuts every column of the asset into its runs of opaque texels. Returns
+/// false if they do not fit in memory.
+static bool build_runs(asset_t* asset) {
+    int _w = asset->surface->w, _h = asset->surface->h;
+    free(asset->runs);
+    free(asset->column_runs);
+    asset->column_runs = malloc((_w + 1) * sizeof(Uint32));
+    // At most one run every other texel
+    asset->runs = malloc(((size_t)_w * (_h + 1) / 2) * sizeof(texel_run_t));
+    if (asset->runs == NULL || asset->column_runs == NULL) {
+        return false;
+    }
+
+    Uint32 _run_number = 0;
+    for (int x = 0; x < _w; x++) {
+        asset->column_runs[x] = _run_number;
+        const Uint8* _column = asset->columns + (size_t)x * _h;
+        for (int y = 0; y < _h; y++) {
+            if (_column[y] == PALETTE_TRANSPARENT) {
+                continue;
+            }
+            int _start = y;
+            while (y < _h && _column[y] != PALETTE_TRANSPARENT) {
+                y++;
+            }
+            asset->runs[_run_number++] = (texel_run_t){_start, y};
+        }
+    }
+    asset->column_runs[_w] = _run_number;
+    return true;
+}
+
+/// Quantizes every image asset to one shared 256-color palette and fills
+/// their indices and opaque runs, then precomputes the colormaps
+bool build_palette() {
+    for (int a = 0; a < ASSET_COUNT; a++) {
+        asset_t* asset = &assets[a];
+        if (asset->kind != ASSET_IMAGE) {
+            continue;
+        }
+        // Rows for the floor casting, columns for the walls and sprites
+        size_t _size = (size_t)asset->surface->w * asset->surface->h;
+        free(asset->rows);
+        free(asset->columns);
+        asset->rows = malloc(_size);
+        asset->columns = malloc(_size);
+        if (asset->rows == NULL || asset->columns == NULL) {
+            fprintf(stderr, "Error at palette building: cannot allocate %s indices\n",
+                    asset->name);
+            return false;
+        }
+    }
+
+    memset(bin_count, 0, sizeof(bin_count));
+    memset(bin_sum, 0, sizeof(bin_sum));
+    each_image_texel(count_texel);
+
+    static color_box_t boxes[PALETTE_SIZE - 1];
+    int _box_number = median_cut(boxes);
+
+    palette[PALETTE_TRANSPARENT] = 0;
+    for (int i = 0; i < _box_number; i++) {
+        Uint64 _sum[3] = {0, 0, 0};
+        for (int b = boxes[i].start; b < boxes[i].end; b++) {
+            for (int c = 0; c < 3; c++) {
+                _sum[c] += bin_sum[bins[b]][c];
+            }
+            bin_index[bins[b]] = i + 1;
+        }
+        Uint32 _r = _sum[2] / boxes[i].count;
+        Uint32 _g = _sum[1] / boxes[i].count;
+        Uint32 _b = _sum[0] / boxes[i].count;
+        palette[i + 1] = 0xff000000 | _r << 16 | _g << 8 | _b;
+    }
+
+    each_image_texel(index_texel);
+    for (int a = 0; a < ASSET_COUNT; a++) {
+        if (assets[a].kind == ASSET_IMAGE && !build_runs(&assets[a])) {
+            fprintf(stderr, "Error at palette building: cannot allocate %s runs\n",
+                    assets[a].name);
+            return false;
+        }
+    }
+    build_colormaps();
+    return true;
+}
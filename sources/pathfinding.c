@@ -0,0 +1,329 @@
+#include "pathfinding.h"
+#include "map.h"
+#include <stdlib.h>
+#include <string.h>
+
+_Thread_local flow_field_t* flow_field = NULL;
+
+// Centered on the player, the window never leaves the chunks prefetched
+// around theirs: a rebuild never reads a chunk on the spot
+_Static_assert(FLOW_FIELD_SIZE / 2 <= CHUNK_PREFETCH_RADIUS * CHUNK_SIZE,
+               "the flow field reaches past the prefetched chunks");
+
+// 4-connected neighbourhood, the order decides ties between equal paths
+static const flow_dir_t neighbours[4] = {{1, 0}, {-1, 0}, {0, 1}, {0, -1}};
+
+/// Doors only let enemies through once fully opened, the solidity grid
+/// already knows
+bool is_walkable(int col, int row) { return !world_solid(col, row); }
+
+/// Cost of entering a walkable tile. A prop standing there (another enemy,
+/// a barrel) is walked around if a path at most FLOW_OCCUPIED_COST tiles
+/// longer exists, walked through otherwise.
+static int step_cost(int col, int row) {
+    return world_occupied(col, row) ? 1 + FLOW_OCCUPIED_COST : 1;
+}
+
+/// Position of a world tile in the window, false if it lies outside
+static bool flow_local(int col, int row, int* x, int* y) {
+    *x = col - flow_field->origin_col;
+    *y = row - flow_field->origin_row;
+    return *x >= 0 && *x < FLOW_FIELD_SIZE && *y >= 0 && *y < FLOW_FIELD_SIZE;
+}
+
+/// Forgets the field, computed again on the next flow_field_update
+void flow_field_reset() {
+    flow_field->target_col = flow_field->target_row = -1;
+    flow_field->dirty = true;
+}
+
+/// Reports a tile whose walkability or cost changed (a door fully opened or
+/// closing, a prop killed, an enemy moved): the next call to
+/// flow_field_update repairs the paths going through it
+void flow_field_tile_changed(int col, int row) {
+    int _x, _y;
+    if (flow_field->dirty || !flow_local(col, row, &_x, &_y)) {
+        return;
+    }
+    if (flow_field->change_number == FLOW_MAX_CHANGES) {
+        flow_field->dirty = true; // Cheaper to start over
+        return;
+    }
+    flow_field->changes[flow_field->change_number++] = _y * FLOW_FIELD_SIZE + _x;
+}
+
+/// Starts a rebuild or a repair with no tile marked
+static void clear_marks() {
+    if (++flow_field->stamp == 0) {
+        memset(flow_field->affected_mark, 0, sizeof(flow_field->affected_mark));
+        memset(flow_field->touched_mark, 0, sizeof(flow_field->touched_mark));
+        flow_field->stamp = 1;
+    }
+    flow_field->affected_number = flow_field->touched_number = 0;
+    flow_field->heap_size = 0;
+}
+
+static void affect(int x, int y) {
+    if (flow_field->affected_mark[y][x] != flow_field->stamp) {
+        flow_field->affected_mark[y][x] = flow_field->stamp;
+        flow_field->affected[flow_field->affected_number++] = y * FLOW_FIELD_SIZE + x;
+    }
+}
+
+static void touch(int x, int y) {
+    if (flow_field->touched_mark[y][x] != flow_field->stamp) {
+        flow_field->touched_mark[y][x] = flow_field->stamp;
+        flow_field->touched[flow_field->touched_number++] = y * FLOW_FIELD_SIZE + x;
+    }
+}
+
+/// Sets the distance of a tile and queues it. Ties between equal costs are
+/// broken by position, so the same field comes out of any order of pushes.
+static void heap_push(int x, int y, int distance) {
+    int* heap = flow_field->heap;
+    int _key = distance * FLOW_TILES + y * FLOW_FIELD_SIZE + x;
+    int i = flow_field->heap_size++;
+
+    flow_field->distance[y][x] = distance;
+    touch(x, y);
+    while (i > 0 && heap[(i - 1) / 2] > _key) {
+        heap[i] = heap[(i - 1) / 2];
+        i = (i - 1) / 2;
+    }
+    heap[i] = _key;
+}
+
+static int heap_pop() {
+    int* heap = flow_field->heap;
+    int _top = heap[0];
+    int _last = heap[--flow_field->heap_size];
+    int i = 0;
+
+    for (;;) {
+        int _child = 2 * i + 1;
+        if (_child >= flow_field->heap_size) {
+            break;
+        }
+        if (_child + 1 < flow_field->heap_size && heap[_child + 1] < heap[_child]) {
+            _child++;
+        }
+        if (heap[_child] >= _last) {
+            break;
+        }
+        heap[i] = heap[_child];
+        i = _child;
+    }
+    heap[i] = _last;
+    return _top;
+}
+
+/// Dijkstra from the queued tiles: every tile a cheaper path reaches gets
+/// its new distance. Entering a tile never costs less than 1, so a tile
+/// popped with its current distance is never improved again.
+static void settle() {
+    while (flow_field->heap_size > 0) {
+        int _key = heap_pop();
+        int _distance = _key / FLOW_TILES;
+        int _x = _key % FLOW_TILES % FLOW_FIELD_SIZE;
+        int _y = _key % FLOW_TILES / FLOW_FIELD_SIZE;
+        if (flow_field->distance[_y][_x] != _distance) {
+            continue; // Improved since it was queued
+        }
+
+        for (int i = 0; i < 4; i++) {
+            int _nx = _x + neighbours[i].dx;
+            int _ny = _y + neighbours[i].dy;
+            if (_nx < 0 || _nx >= FLOW_FIELD_SIZE || _ny < 0 || _ny >= FLOW_FIELD_SIZE) {
+                continue;
+            }
+            int _col = flow_field->origin_col + _nx, _row = flow_field->origin_row + _ny;
+            if (!is_walkable(_col, _row)) {
+                continue;
+            }
+            int _next = _distance + step_cost(_col, _row);
+            int _old = flow_field->distance[_ny][_nx];
+            if (_old == FLOW_UNREACHABLE || _next < _old) {
+                heap_push(_nx, _ny, _next);
+            }
+        }
+    }
+}
+
+/// Points a tile to its closest neighbour, the first one in the order of
+/// neighbours on a tie: the direction only depends on the distances, a
+/// repaired field matches a rebuilt one
+static void pick_direction(int x, int y) {
+    int _best = FLOW_UNREACHABLE;
+
+    flow_field->dir[y][x] = (flow_dir_t){0, 0};
+    if (flow_field->distance[y][x] <= 0) { // Unreachable or the target itself
+        return;
+    }
+    for (int i = 0; i < 4; i++) {
+        int _nx = x + neighbours[i].dx;
+        int _ny = y + neighbours[i].dy;
+        if (_nx < 0 || _nx >= FLOW_FIELD_SIZE || _ny < 0 || _ny >= FLOW_FIELD_SIZE) {
+            continue;
+        }
+        int _distance = flow_field->distance[_ny][_nx];
+        if (_distance != FLOW_UNREACHABLE && (_best == FLOW_UNREACHABLE || _distance < _best)) {
+            _best = _distance;
+            flow_field->dir[y][x] = neighbours[i];
+        }
+    }
+}
+
+static void flow_field_compute(int col, int row) {
+    for (int y = 0; y < FLOW_FIELD_SIZE; y++) {
+        for (int x = 0; x < FLOW_FIELD_SIZE; x++) {
+            flow_field->distance[y][x] = FLOW_UNREACHABLE;
+            flow_field->dir[y][x] = (flow_dir_t){0, 0};
+        }
+    }
+
+    flow_field->origin_col = col - FLOW_FIELD_SIZE / 2;
+    flow_field->origin_row = row - FLOW_FIELD_SIZE / 2;
+    flow_field->target_col = col;
+    flow_field->target_row = row;
+    flow_field->dirty = false;
+    flow_field->spawns = world->spawns;
+    flow_field->change_number = 0;
+
+    if (col < 0 || col >= world->width || row < 0 || row >= world->height) {
+        return;
+    }
+
+    clear_marks();
+    heap_push(FLOW_FIELD_SIZE / 2, FLOW_FIELD_SIZE / 2, 0);
+    settle();
+    for (int i = 0; i < flow_field->touched_number; i++) {
+        pick_direction(flow_field->touched[i] % FLOW_FIELD_SIZE,
+                       flow_field->touched[i] / FLOW_FIELD_SIZE);
+    }
+}
+
+/// Repairs the field after the tiles in changes changed. The tiles whose
+/// path went through one of them forget their distance and take the best
+/// one their other neighbours offer, then Dijkstra spreads from them, as
+/// from any tile made cheaper. Only the affected tiles and the ones they
+/// reach with a cheaper path are visited.
+static void flow_field_repair() {
+    clear_marks();
+    for (int i = 0; i < flow_field->change_number; i++) {
+        affect(flow_field->changes[i] % FLOW_FIELD_SIZE, flow_field->changes[i] / FLOW_FIELD_SIZE);
+    }
+    flow_field->change_number = 0;
+
+    // The tiles pointing to an affected tile are affected in turn
+    for (int i = 0; i < flow_field->affected_number; i++) {
+        int _x = flow_field->affected[i] % FLOW_FIELD_SIZE;
+        int _y = flow_field->affected[i] / FLOW_FIELD_SIZE;
+        for (int j = 0; j < 4; j++) {
+            int _nx = _x + neighbours[j].dx;
+            int _ny = _y + neighbours[j].dy;
+            if (_nx >= 0 && _nx < FLOW_FIELD_SIZE && _ny >= 0 && _ny < FLOW_FIELD_SIZE &&
+                flow_field->distance[_ny][_nx] != FLOW_UNREACHABLE &&
+                _nx + flow_field->dir[_ny][_nx].dx == _x &&
+                _ny + flow_field->dir[_ny][_nx].dy == _y) {
+                affect(_nx, _ny);
+            }
+        }
+    }
+    for (int i = 0; i < flow_field->affected_number; i++) {
+        int _x = flow_field->affected[i] % FLOW_FIELD_SIZE;
+        int _y = flow_field->affected[i] / FLOW_FIELD_SIZE;
+        flow_field->distance[_y][_x] = FLOW_UNREACHABLE;
+        touch(_x, _y);
+    }
+
+    for (int i = 0; i < flow_field->affected_number; i++) {
+        int _x = flow_field->affected[i] % FLOW_FIELD_SIZE;
+        int _y = flow_field->affected[i] / FLOW_FIELD_SIZE;
+        int _col = flow_field->origin_col + _x, _row = flow_field->origin_row + _y;
+        if (_x == FLOW_FIELD_SIZE / 2 && _y == FLOW_FIELD_SIZE / 2) {
+            heap_push(_x, _y, 0);
+            continue;
+        }
+        if (!is_walkable(_col, _row)) {
+            continue;
+        }
+        int _best = FLOW_UNREACHABLE;
+        for (int j = 0; j < 4; j++) {
+            int _nx = _x + neighbours[j].dx;
+            int _ny = _y + neighbours[j].dy;
+            if (_nx < 0 || _nx >= FLOW_FIELD_SIZE || _ny < 0 || _ny >= FLOW_FIELD_SIZE) {
+                continue;
+            }
+            int _distance = flow_field->distance[_ny][_nx];
+            if (flow_field->affected_mark[_ny][_nx] != flow_field->stamp &&
+                _distance != FLOW_UNREACHABLE && (_best == FLOW_UNREACHABLE || _distance < _best)) {
+                _best = _distance;
+            }
+        }
+        if (_best != FLOW_UNREACHABLE) {
+            heap_push(_x, _y, _best + step_cost(_col, _row));
+        }
+    }
+    settle();
+
+    // A direction depends on the distances around its tile
+    for (int i = 0; i < flow_field->touched_number; i++) {
+        int _x = flow_field->touched[i] % FLOW_FIELD_SIZE;
+        int _y = flow_field->touched[i] / FLOW_FIELD_SIZE;
+        pick_direction(_x, _y);
+        for (int j = 0; j < 4; j++) {
+            int _nx = _x + neighbours[j].dx;
+            int _ny = _y + neighbours[j].dy;
+            if (_nx >= 0 && _nx < FLOW_FIELD_SIZE && _ny >= 0 && _ny < FLOW_FIELD_SIZE) {
+                pick_direction(_nx, _ny);
+            }
+        }
+    }
+}
+
+/// Rebuilds the flow field if the target changed tile since the last call,
+/// if props came or went with their chunk, or if the field has been
+/// invalidated, else repairs the tiles changed meanwhile. Returns true on
+/// rebuild.
+bool flow_field_update(vector_t target) {
+    int _col = (int)target.x / TILE_WIDTH;
+    int _row = (int)target.y / TILE_HEIGHT;
+
+    if (flow_field->dirty || _col != flow_field->target_col || _row != flow_field->target_row ||
+        flow_field->spawns != world->spawns) {
+        flow_field_compute(_col, _row);
+        return true;
+    }
+    if (flow_field->change_number > 0) {
+        flow_field_repair();
+    }
+    return false;
+}
+
+/// Moves pos by at most step pixels along the flow field. The entity heads
+/// to the center of the next tile so it never cuts through wall corners, and
+/// stops once it stands next to the target.
+vector_t flow_field_step(vector_t pos, double step) {
+    int _col = (int)pos.x / TILE_WIDTH;
+    int _row = (int)pos.y / TILE_HEIGHT;
+
+    int _x, _y;
+    if (!flow_local(_col, _row, &_x, &_y)) {
+        return pos;
+    }
+    if (flow_field->distance[_y][_x] == FLOW_UNREACHABLE ||
+        abs(_col - flow_field->target_col) + abs(_row - flow_field->target_row) <= 1) {
+        return pos; // Next to the target
+    }
+
+    flow_dir_t _dir = flow_field->dir[_y][_x];
+    vector_t _next = {(_col + _dir.dx) * TILE_WIDTH + TILE_WIDTH / 2,
+                      (_row + _dir.dy) * TILE_HEIGHT + TILE_HEIGHT / 2};
+    vector_t _delta = sub_vector(_next, pos);
+    double _length = norm2(_delta);
+
+    if (_length <= step) {
+        return _next;
+    }
+    return add_vector(pos, mult_vector(_delta, step / _length));
+}
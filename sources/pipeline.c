@@ -0,0 +1,143 @@
+#include "pipeline.h"
+#include <SDL2/SDL_timer.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+// Frame n is stepped from the input of frame n - 1, which is kept in
+// inputs[(n - 1) % 2], and its state saved into states[n % 2]. The
+// simulation is never more than one frame ahead of the drawing, so it only
+// overwrites a state once the caller restored it: the buffers change hands
+// through the two semaphores alone, which only enter the kernel to sleep.
+//
+// Waiting is deliberate. Every input is stepped exactly once and every state
+// drawn exactly once, in order, so a replay renders the same frames however
+// the threads are scheduled. A latest-state-wins swap would never block, but
+// when the simulation is late it could only draw the last state again, and
+// which frames are shown would then depend on timing. Without contention a
+// handoff is one atomic operation on each side.
+static struct {
+    bool running;
+    raycaster_t* sim;  // Stepped by the simulation thread only
+    raycaster_t* view; // Restored and drawn by the caller only
+    void* states[2];
+    size_t state_size;
+    frame_input_t inputs[2];
+    atomic_long submitted; // Inputs handed to the simulation
+    long drawn;            // States restored, caller only
+    atomic_bool failed;
+    sem_t input_ready; // One post per submitted input, and one to stop
+    sem_t state_ready; // One post per saved state, or on failure
+    pthread_t thread;
+
+    // Statistics, printed on exit
+    long steps;
+    Uint64 step_ticks; // On the simulation thread
+    Uint64 wait_ticks; // Of the caller for a state
+} pipeline;
+
+static void* pipeline_simulate(void* arg) {
+    for (long n = 1;; n++) {
+        sem_wait(&pipeline.input_ready);
+        if (atomic_load(&pipeline.submitted) < n) {
+            break; // Woken to stop
+        }
+
+        Uint64 _start = SDL_GetPerformanceCounter();
+        bool _ok = raycaster_step(pipeline.sim, &pipeline.inputs[(n - 1) % 2]) &&
+                   raycaster_save(pipeline.sim, pipeline.states[n % 2], pipeline.state_size);
+        pipeline.step_ticks += SDL_GetPerformanceCounter() - _start;
+        pipeline.steps++;
+        if (!_ok) {
+            atomic_store(&pipeline.failed, true);
+            sem_post(&pipeline.state_ready);
+            break;
+        }
+        sem_post(&pipeline.state_ready);
+    }
+    return NULL;
+}
+
+bool pipeline_start(const char* world_path) {
+    atomic_init(&pipeline.submitted, 0);
+    pipeline.drawn = 0;
+    pipeline.steps = 0;
+    pipeline.step_ticks = 0;
+    pipeline.wait_ticks = 0;
+    atomic_init(&pipeline.failed, false);
+
+    pipeline.sim = raycaster_create();
+    pipeline.view = raycaster_create();
+    if (pipeline.sim == NULL || pipeline.view == NULL ||
+        !raycaster_load_level(pipeline.sim, world_path) ||
+        !raycaster_load_level(pipeline.view, world_path)) {
+        return false;
+    }
+
+    pipeline.state_size = raycaster_snapshot_size(pipeline.sim);
+    bool _ok = true;
+    for (int i = 0; i < 2; i++) {
+        pipeline.states[i] = malloc(pipeline.state_size);
+        _ok = _ok && pipeline.states[i] != NULL;
+    }
+    _ok = _ok && raycaster_save(pipeline.sim, pipeline.states[0], pipeline.state_size);
+    _ok = _ok && sem_init(&pipeline.input_ready, 0, 0) == 0;
+    _ok = _ok && sem_init(&pipeline.state_ready, 0, 1) == 0; // Frame 0 is ready
+    if (!_ok || pthread_create(&pipeline.thread, NULL, pipeline_simulate, NULL) != 0) {
+        fprintf(stderr, "Error at pipeline: cannot start the simulation\n");
+        return false;
+    }
+    pipeline.running = true;
+    return true;
+}
+
+void pipeline_submit(const frame_input_t* input) {
+    long _frame = atomic_load(&pipeline.submitted);
+    pipeline.inputs[_frame % 2] = *input;
+    atomic_store(&pipeline.submitted, _frame + 1);
+    sem_post(&pipeline.input_ready);
+}
+
+raycaster_t* pipeline_acquire() {
+    Uint64 _start = SDL_GetPerformanceCounter();
+    sem_wait(&pipeline.state_ready);
+    pipeline.wait_ticks += SDL_GetPerformanceCounter() - _start;
+    if (atomic_load(&pipeline.failed) ||
+        !raycaster_restore(pipeline.view, pipeline.states[pipeline.drawn % 2],
+                           pipeline.state_size)) {
+        return NULL;
+    }
+    pipeline.drawn++;
+    return pipeline.view;
+}
+
+void pipeline_stop(const render_backend_t* backend) {
+    if (pipeline.running) {
+        sem_post(&pipeline.input_ready);
+        pthread_join(pipeline.thread, NULL);
+        sem_destroy(&pipeline.input_ready);
+        sem_destroy(&pipeline.state_ready);
+        pipeline.running = false;
+    }
+
+    if (backend != NULL && pipeline.drawn > 0) {
+        raycaster_print_stats(pipeline.view, backend);
+        raycaster_print_stats(pipeline.sim, backend);
+        double _ticks_per_ms = SDL_GetPerformanceFrequency() / 1000.0;
+        printf("[ STATS ] pipeline: simulation %.3f ms/frame on its thread, drawing waited "
+               "%.3f ms/frame for it\n",
+               pipeline.steps > 0 ? pipeline.step_ticks / _ticks_per_ms / pipeline.steps : 0.0,
+               pipeline.wait_ticks / _ticks_per_ms / pipeline.drawn);
+    }
+
+    for (int i = 0; i < 2; i++) {
+        free(pipeline.states[i]);
+        pipeline.states[i] = NULL;
+    }
+    raycaster_destroy(pipeline.sim);
+    raycaster_destroy(pipeline.view);
+    pipeline.sim = NULL;
+    pipeline.view = NULL;
+}
@@ -0,0 +1,1482 @@
+#include "raycaster.h"
+#include "arena.h"
+#include "assets.h"
+#include "door.h"
+#include "los.h"
+#include "map.h"
+#include "palette.h"
+#include "pathfinding.h"
+#include "sprite.h"
+#include <math.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// IDLE: not firing
+// LOADING: start to fire (for minigun, not for gun, consists in 2 first frames)
+// FIRING: firing animation
+typedef enum { IDLE, LOADING, FIRING } gun_anim_state;
+
+static const vector_t i_pos = {96, 64 * 10};
+static const vector_t i_dir = {1, 0};
+
+// Chunks of the flow field window, wherever it lies on the grid
+#define FLOW_FIELD_CHUNKS ((FLOW_FIELD_SIZE + CHUNK_SIZE - 2) / CHUNK_SIZE + 1)
+
+// A frame reads the chunks prefetched around the player, the ones of the
+// flow field window and the ones a group of lines of sight peeks: none of
+// them may evict another
+_Static_assert(CHUNK_PREFETCH_SPAN * CHUNK_PREFETCH_SPAN + FLOW_FIELD_CHUNKS * FLOW_FIELD_CHUNKS +
+                       LOS_PEEK_CHUNKS <=
+                   CHUNK_CACHE_SIZE,
+               "the chunks of a frame do not fit in the cache");
+
+// ----------------------------------------------------------
+// Instances: everything a game writes. Assets, palette and levels are
+// shared read-only; the module states of the world, props, doors, flow
+// field and lines of sight point into the instance running on the thread.
+// ----------------------------------------------------------
+
+struct raycaster {
+    // -----------
+    // Player
+    // -----------
+
+    player_t player;
+    gun_anim_state gun_state;
+    bool is_firing;
+    int ammo;
+    int ammo_cpt;   // Frames before one bullet is spent
+    int dmg;        // Weapon damage
+    int anim_frame; // Frame of the gun animation
+    int gun_offset; // Picture of the gun sheet drawn
+
+    // --------------------------------
+    // Raycasting status variable
+    // --------------------------------
+
+    int side; // 0 = horizontal ; 1 = vertical
+    int cx;
+    int cy;
+    bool hitx;
+    bool hity;
+
+    // ----------------------------------------------------------
+    // Static scene: floor, ceiling and walls. They only change with the
+    // camera and the doors, so the last ones are kept with their columns
+    // and reused while neither moves.
+    // ----------------------------------------------------------
+
+    column_span_t wall_columns[(int)WW];
+    double wall_distance[(int)WW];
+    int floor_start[(int)WW];           // First floor row of each column, from the horizon
+    raycaster_hit_t wall_hits[(int)WW]; // What each column hit, kept with the scene
+    struct {
+        bool valid;
+        render_backend_t* backend; // Holding the scene
+        vector_t pos;
+        vector_t dir;
+        unsigned long revision;
+    } scene;
+
+    world_t world;
+    prop_set_t props;
+    door_set_t doors;
+    flow_field_t flow_field;
+    los_t los;
+
+    arena_t frame_arena;              // Scratch memory of the current draw or step
+    render_backend_t* memory_backend; // Created by the first raycaster_render
+
+    // Wall and sprite submission statistics, printed on exit
+    Uint64 submit_ticks;
+    Uint64 submit_frames;
+    unsigned long step_frames;
+    Uint64 floor_ticks;
+    unsigned long scene_casts;   // Frames whose scene was cast, not reused
+    unsigned long wall_rays;     // Full casts
+    unsigned long pvs_culled;    // Props rejected by the PVS of the player's tile
+    unsigned long floor_skipped; // Floor and ceiling pixel pairs hidden by the walls
+};
+
+static _Thread_local raycaster_t* game = NULL; // Instance running on this thread
+
+/// Makes the instance the one the modules work on, on this thread
+static void use_instance(raycaster_t* rc) {
+    game = rc;
+    world = &rc->world;
+    prop_set = &rc->props;
+    door_set = &rc->doors;
+    flow_field = &rc->flow_field;
+    los = &rc->los;
+}
+
+static vector_t find_next_point(vector_t pos, vector_t dir) {
+    double dydx = differential(dir);
+    double _x, _y;
+
+    vector_t dx;
+    vector_t dy;
+
+    game->cx = dir.x > 0 ? 1 : -1;
+    game->cy = dir.y > 0 ? 1 : -1;
+
+    // ----------
+    // X axis
+    // ----------
+
+    if (dir.x > 0) { // Oriented to right
+        _x = TILE_WIDTH - (int)(pos.x) % TILE_WIDTH;
+    } else { // Oriented to left
+        _x = -(int)(pos.x) % TILE_WIDTH;
+        if (_x == 0)
+            _x = -TILE_WIDTH;
+    }
+    vector_t _dx = {_x, _x * dydx};
+    dx = _dx;
+
+    // ----------
+    // Y axis
+    // ----------
+
+    if (dir.y > 0) { // Oriented to down
+        _y = TILE_HEIGHT - (int)(pos.y) % TILE_HEIGHT;
+    } else { // Oriented to top
+        _y = -(int)(pos.y) % TILE_HEIGHT;
+        if (_y == 0)
+            _y = -TILE_HEIGHT;
+    }
+    vector_t _dy = {_y / dydx, _y};
+    dy = _dy;
+
+    if (norm2(dy) < norm2(dx)) {
+        game->hity = true;
+        game->hitx = false;
+        return add_vector(pos, dy);
+    } else {
+        game->hity = false;
+        game->hitx = true;
+        return add_vector(pos, dx);
+    }
+}
+
+static bool hit_x() { return game->hitx; }
+static bool hit_y() { return game->hity; }
+static bool forward_x() { return game->cx == 1 ? true : false; }
+static bool forward_y() { return game->cy == 1 ? true : false; }
+
+// Intersects the ray with the door plane, inset half a tile inside the door
+// tile the ray just entered at hit. Returns true if the closed part of the
+// door is hit, in which case hit is moved onto the door plane.
+static bool hit_door(door_t* door, vector_t ray, vector_t* hit) {
+    double slope = differential(ray);
+    double dx, dy;
+
+    if (hit_x()) {
+        dx = game->cx * (double)TILE_WIDTH / 2;
+        dy = dx * slope;
+    } else {
+        dy = game->cy * (double)TILE_HEIGHT / 2;
+        dx = dy / slope;
+    }
+    vector_t door_hit = {hit->x + dx, hit->y + dy};
+
+    // The ray leaves the tile through a side before reaching the door plane
+    if ((int)door_hit.x / TILE_WIDTH != door->col || (int)door_hit.y / TILE_HEIGHT != door->row) {
+        return false;
+    }
+
+    int _length;
+    if (hit_x()) {
+        _length = (int)door_hit.y % TILE_HEIGHT;
+    } else {
+        _length = (int)door_hit.x % TILE_WIDTH;
+    }
+    if (_length > TILE_WIDTH - door->open) { // Going through the opened part
+        return false;
+    }
+    *hit = door_hit;
+    return true;
+}
+
+// Returns true if it hits a door. Door planes are intersected during the
+// traversal, so a ray going through an opened door keeps on going without
+// being cast again.
+bool get_wall_hit(vector_t pos, vector_t dir, double frac, vector_t* hit, vector_t* ray, int* col,
+                  int* row) {
+    vector_t _cam_ray = mult_vector(camera_segment(game->player), frac);
+    vector_t _ray = add_vector((game->player.dir), _cam_ray);
+    vector_t _hit = find_next_point(game->player.pos, _ray); // Intersection with grid
+    int _col, _row;
+    vector_t p = game->player.pos;
+    bool ret = false;
+
+    for (int i = 0; i < MAX_RAY_STEPS; i++) {
+        _hit = find_next_point(p, _ray);
+        // set_color(top_renderer, yellow);
+
+        _col = (int)_hit.x / TILE_WIDTH;
+        _row = (int)_hit.y / TILE_HEIGHT;
+
+        // Start by correction if a ray hits the top-left corner
+        if ((int)_hit.x % TILE_WIDTH == 0 && (int)_hit.y % TILE_HEIGHT == 0 &&
+            !world_opaque(_col, _row)) {
+            if (game->cy == -1) {
+                _row--;
+            }
+            if (game->cx == -1) {
+                _col--;
+            }
+        } else if (hit_x()) {
+            if (!forward_x()) {
+                _col--;
+            }
+        } else if (hit_y()) {
+            if (!forward_y()) {
+                _row--;
+            }
+        } else {
+            fprintf(stderr, "[ ERROR ] Should have hit something\n");
+            exit(EXIT_FAILURE);
+        }
+
+        // Empty tiles are skipped on a bit test, tile codes only matter
+        // to tell doors from walls
+        if (!world_opaque(_col, _row)) {
+            p = _hit;
+            continue;
+        }
+        if (world_tile(_col, _row) == 'p') {
+            // Past MAX_DOORS, unknown doors are plain walls
+            door_t* _door = door_at(_col, _row);
+            vector_t _door_hit = _hit;
+            if (_door == NULL) {
+                break;
+            }
+            if (hit_door(_door, _ray, &_door_hit)) {
+                _hit = _door_hit;
+                ret = true;
+                break;
+            }
+        } else {
+            break;
+        }
+        p = _hit;
+    }
+    *ray = _ray;
+    *hit = _hit;
+    *col = _col;
+    *row = _row;
+    return ret;
+}
+
+/// Returns the door the player is facing, if it stands within reach
+static door_t* door_in_front() {
+    vector_t _dir = normalize_vector(game->player.dir);
+
+    for (int d = TILE_WIDTH / 4; d <= 3 * TILE_WIDTH / 2; d += TILE_WIDTH / 8) {
+        vector_t _probe = add_vector(game->player.pos, mult_vector(_dir, d));
+        door_t* _door = door_at((int)_probe.x / TILE_WIDTH, (int)_probe.y / TILE_HEIGHT);
+        if (_door != NULL) {
+            return _door;
+        }
+    }
+    return NULL;
+}
+
+// ----------------------------------------------------------
+// Wall spans: rays are only cast on sampled columns. When two of them hit
+// the same face of the same tile, the columns in between see that face too,
+// and their hit is the intersection of their ray with its plane.
+// ----------------------------------------------------------
+
+typedef struct {
+    vector_t hit;
+    vector_t ray;
+    int col;
+    int row;
+    bool door;
+    bool hitx; // Face on a vertical grid line
+} wall_hit_t;
+
+static double column_frac(int x) { return -((2.0 * x / WW) - 1); }
+
+/// Hit of the column x on the grid line holding the face of an other hit
+static wall_hit_t face_hit(const wall_hit_t* face, int x) {
+    wall_hit_t _wall = *face;
+    _wall.ray =
+        add_vector(game->player.dir, mult_vector(camera_segment(game->player), column_frac(x)));
+    if (face->hitx) {
+        double _line = round(face->hit.x / TILE_WIDTH) * TILE_WIDTH;
+        _wall.hit.x = _line;
+        _wall.hit.y = game->player.pos.y + (_line - game->player.pos.x) * _wall.ray.y / _wall.ray.x;
+    } else {
+        double _line = round(face->hit.y / TILE_HEIGHT) * TILE_HEIGHT;
+        _wall.hit.x = game->player.pos.x + (_line - game->player.pos.y) * _wall.ray.x / _wall.ray.y;
+        _wall.hit.y = _line;
+    }
+    return _wall;
+}
+
+static wall_hit_t cast_wall(int x) {
+    wall_hit_t _wall;
+    _wall.door = get_wall_hit(game->player.pos, game->player.dir, column_frac(x), &_wall.hit,
+                              &_wall.ray, &_wall.col, &_wall.row);
+    _wall.hitx = hit_x();
+    game->wall_rays++;
+    // The traversal truncates the positions, so its hits drift off the grid
+    // lines by up to a unit: put them back on the exact face, as the filled
+    // columns are
+    if (!_wall.door && world_opaque(_wall.col, _wall.row)) {
+        return face_hit(&_wall, x);
+    }
+    return _wall;
+}
+
+/// True if both hits lie on one plain wall face, doors being cast each time
+static bool same_face(const wall_hit_t* a, const wall_hit_t* b) {
+    return a->col == b->col && a->row == b->row && a->hitx == b->hitx && !a->door && !b->door &&
+           world_tile(a->col, a->row) != 'p' && world_opaque(a->col, a->row);
+}
+
+/// Span of the wall seen by the column x, to be drawn once the floor is done
+static void set_wall_column(int x, const wall_hit_t* wall, column_span_t* columns) {
+    // ----------------------
+    // Shading the walls
+    // ----------------------
+
+    int _x = (int)wall->hit.x;
+    int _y = (int)wall->hit.y;
+    int _xmod, _ymod;
+
+    if (wall->door) {
+        if (wall->hitx) {
+            _xmod = _x % (TILE_WIDTH / 2);
+            _ymod = _y % TILE_HEIGHT;
+        } else {
+            _xmod = _x % TILE_WIDTH;
+            _ymod = _y % (TILE_HEIGHT / 2);
+        }
+    } else {
+        _xmod = _x % TILE_WIDTH;
+        _ymod = _y % TILE_HEIGHT;
+    }
+
+    if (_xmod == 0 && _ymod != 0) {
+        game->side = 1;
+    } else if (_xmod != 0 && _ymod == 0) {
+        game->side = 0;
+    }
+
+    // ------------------------------------
+    // Rendering the wall vertical stripe
+    // ------------------------------------
+
+    int _text_offset = 0;
+    switch (world_tile(wall->col, wall->row)) {
+    case 'b': // Brick Wall
+        _text_offset = 1;
+        break;
+    case 'f': // Brick Wall with flag
+        _text_offset = 0;
+        break;
+    case 's': // Stone Wall
+        _text_offset = 3;
+        break;
+    case 'g': // Blue Brick
+        _text_offset = 4;
+        break;
+    case 'w': // Wooden wall
+        _text_offset = 6;
+        break;
+    case 'm': // Mossy Stone Wall
+        _text_offset = 5;
+        break;
+    case 't': // Terracota Wall
+        _text_offset = 7;
+        break;
+    case 'p': // Door
+        if (wall->door)
+            _text_offset = 8;
+        else
+            _text_offset = 9;
+        break;
+    }
+
+    _text_offset *= TEXTURE_WIDTH;
+
+    double _distance = get_distance(game->player.pos, wall->hit);
+    double _orthogonal_distance = get_cos(wall->ray, game->player.dir) * _distance;
+    double _wall_height = 64 * WH / _orthogonal_distance;
+    double _frac_text = game->side == 0 ? _xmod : _ymod;
+
+    SDL_Rect src = {_text_offset + _frac_text, 0, 1, TEXTURE_HEIGHT};
+
+    if (wall->door) {
+        src.x += door_at(wall->col, wall->row)->open;
+    }
+
+    column_span_t _span = {x, (WH - _wall_height) / 2, _wall_height, ASSET_WALLS,
+                           src, !game->side, _orthogonal_distance, -1};
+    columns[x] = _span;
+
+    raycaster_face _face = wall->hitx ? (wall->ray.x > 0 ? FACE_WEST : FACE_EAST)
+                                      : (wall->ray.y > 0 ? FACE_NORTH : FACE_SOUTH);
+    raycaster_hit_t _hit = {wall->col,
+                            wall->row,
+                            world_tile(wall->col, wall->row),
+                            wall->door,
+                            _face,
+                            (float)(src.x - _text_offset) / TEXTURE_WIDTH,
+                            _orthogonal_distance};
+    game->wall_hits[x] = _hit;
+}
+
+/// Sets the columns strictly between x0 and x1, whose hits are known:
+/// filled from the face they share, or split in two around a new cast
+static void fill_wall_columns(int x0, const wall_hit_t* a, int x1, const wall_hit_t* b,
+                              column_span_t* columns) {
+    if (x1 - x0 < 2) {
+        return;
+    }
+    if (same_face(a, b)) {
+        for (int x = x0 + 1; x < x1; x++) {
+            wall_hit_t _wall = face_hit(a, x);
+            set_wall_column(x, &_wall, columns);
+        }
+        return;
+    }
+    int _mid = (x0 + x1) / 2;
+    wall_hit_t _wall = cast_wall(_mid);
+    set_wall_column(_mid, &_wall, columns);
+    fill_wall_columns(x0, a, _mid, &_wall, columns);
+    fill_wall_columns(_mid, &_wall, x1, b, columns);
+}
+
+/// Pixels of a floor row left in the current tile along one axis, from the
+/// coordinate v moving by step every pixel
+static inline double pixels_in_tile(double v, double step, int tile_size) {
+    double _tile = floor(v / tile_size) * tile_size;
+    if (step > 0) {
+        return ceil((_tile + tile_size - v) / step);
+    }
+    if (step < 0) {
+        return floor((v - _tile) / -step) + 1;
+    }
+    return INFINITY;
+}
+
+/// Texel offsets, in the atlas row, of the floor and ceiling slots of the
+/// tile under a floor point. Tiles outside of the world, or of chunks not
+/// resident (only ever hidden behind a wall), get the default slots.
+static void floor_slots(vector_t point, int slots, int* floor_base, int* ceiling_base) {
+    int _floor = FLOOR_SLOT, _ceiling = CEILING_SLOT;
+    // Also false for the infinite distance of the horizon row
+    if (point.x >= 0 && point.y >= 0 && point.x < world->width * TILE_WIDTH &&
+        point.y < world->height * TILE_HEIGHT) {
+        int _col = (int)point.x / TILE_WIDTH, _row = (int)point.y / TILE_HEIGHT;
+        const chunk_data_t* chunk = world_resident_chunk(_col, _row);
+        if (chunk != NULL) {
+            _floor = chunk->floors[_row % CHUNK_SIZE][_col % CHUNK_SIZE];
+            _ceiling = chunk->ceilings[_row % CHUNK_SIZE][_col % CHUNK_SIZE];
+        }
+    }
+    *floor_base = (_floor < slots ? _floor : FLOOR_SLOT) * TEXTURE_WIDTH;
+    *ceiling_base = (_ceiling < slots ? _ceiling : CEILING_SLOT) * TEXTURE_WIDTH;
+}
+
+/// Casts and draws the walls, floor and ceiling. Returns the time spent on
+/// the floor and ceiling.
+static Uint64 cast_scene(render_backend_t* backend, vector_t cam_seg) {
+    // Corner hits keep the shading of the column before: start each scene
+    // alike, so that it only depends on the camera and the doors
+    game->side = 0;
+
+    // Sampled columns every WALL_SPAN_STEP, the span between two of
+    // them being cast again only where the faces hit differ
+    wall_hit_t _prev_wall = cast_wall(0);
+    set_wall_column(0, &_prev_wall, game->wall_columns);
+    for (int x = 0; x < WW - 1;) {
+        int _next = x + WALL_SPAN_STEP < WW - 1 ? x + WALL_SPAN_STEP : WW - 1;
+        wall_hit_t _wall = cast_wall(_next);
+        set_wall_column(_next, &_wall, game->wall_columns);
+        fill_wall_columns(x, &_prev_wall, _next, &_wall, game->wall_columns);
+        _prev_wall = _wall;
+        x = _next;
+    }
+
+    // Walls are centered on the horizon: the floor of a column starts on
+    // the first row below its wall, the ceiling mirrors it. Rows the wall
+    // only partly covers are cast anyway, the wall is drawn over them.
+    for (int x = 0; x < WW; x++) {
+        game->wall_distance[x] = game->wall_columns[x].distance;
+        game->floor_start[x] =
+            (int)floor(game->wall_columns[x].top + game->wall_columns[x].height) - (int)WH / 2;
+    }
+
+    // -----------------
+    // Floor casting
+    // -----------------
+
+    // Row-major texel indices: the floor walks the rows of the texture
+    const Uint8* texture_indices = assets[ASSET_WALLS].rows;
+    const int texture_stride = assets[ASSET_WALLS].surface->w;
+    const int _texture_slots = texture_stride / TEXTURE_WIDTH;
+    Uint64 _floor_start = SDL_GetPerformanceCounter();
+    Uint32* buffer = backend->begin_frame(backend);
+    float* depth = backend->depth;
+    // The floor ends on the last row, the ceiling one step further on the
+    // first one: rows the cast leaves out would keep older frames
+    for (int y = 0; y <= WH / 2; y++) {
+        bool _floor_row = y < WH / 2;
+        double z = WH / 2;
+        // Use Thales' Theorem and similar triangle
+        double d = 64 * z / y; // d is the horizontal distance to the ground
+        vector_t dir = mult_vector(game->player.dir, d);
+        vector_t cam = mult_vector(cam_seg, d);
+        vector_t lray = add_vector(game->player.pos, add_vector(dir, cam));
+        vector_t rray = add_vector(game->player.pos, add_vector(dir, mult_vector(cam, -1)));
+
+        double floor_step_x = (rray.x - lray.x) / WW;
+        double floor_step_y = (rray.y - lray.y) / WW;
+
+        vector_t floor = {lray.x, lray.y};
+        const Uint32* _colormap = get_colormap(d, false);
+
+        // The row is walked in spans between two crossings of tile edges:
+        // the floor and ceiling of the tile are looked up once per span
+        for (int x = 0; x < WW;) {
+            double _n = fmin(pixels_in_tile(floor.x, floor_step_x, TILE_WIDTH),
+                             pixels_in_tile(floor.y, floor_step_y, TILE_HEIGHT));
+            int _end = _n >= WW - x ? WW : _n >= 1 ? x + (int)_n : x + 1;
+
+            // Pixels behind the walls leave tiles of their own unread
+            for (; x < _end && y < game->floor_start[x];
+                 x++, floor.x += floor_step_x, floor.y += floor_step_y) {
+                game->floor_skipped++;
+            }
+            if (x == _end) {
+                continue;
+            }
+            int _floor_base, _ceiling_base;
+            floor_slots(floor, _texture_slots, &_floor_base, &_ceiling_base);
+
+            for (; x < _end; x++, floor.x += floor_step_x, floor.y += floor_step_y) {
+                if (y < game->floor_start[x]) {
+                    game->floor_skipped++;
+                    continue; // Behind the wall of that column
+                }
+                // Masking (texture sizes are powers of 2) also wraps the
+                // negative coordinates seen past the edges of the map
+                int tx = (int)floor.x & (TEXTURE_WIDTH - 1);
+                int ty = (int)floor.y & (TEXTURE_HEIGHT - 1);
+
+                // The whole row is at the same distance: one fog level
+                const Uint8* _texel_row = texture_indices + ty * texture_stride + tx;
+                Uint32 pixel_floor = _colormap[_texel_row[_floor_base]];
+                Uint32 pixel_ceiling = _colormap[_texel_row[_ceiling_base]];
+                buffer[x + (int)WW * (int)WH / 2 - (int)WW * y] = pixel_ceiling;
+                if (_floor_row) {
+                    buffer[x + (int)WW * (int)WH / 2 + (int)WW * y] = pixel_floor;
+                }
+                if (depth != NULL) {
+                    depth[x + (int)WW * (int)WH / 2 - (int)WW * y] = d;
+                    if (_floor_row) {
+                        depth[x + (int)WW * (int)WH / 2 + (int)WW * y] = d;
+                    }
+                }
+            }
+        }
+    }
+
+    Uint64 _floor_ticks = SDL_GetPerformanceCounter() - _floor_start;
+    game->floor_ticks += _floor_ticks;
+
+    for (int x = 0; x < WW; x++) {
+        backend->draw_column(backend, &game->wall_columns[x]);
+    }
+    return _floor_ticks;
+}
+
+// A prop as the camera sees it: a square sprite of size pixels, centered
+// x_offset pixels left of the middle of the screen
+typedef struct {
+    double distance; // Orthogonal distance to the camera
+    double x_offset;
+    double size;
+} sprite_projection_t;
+
+static sprite_projection_t project_sprite(vector_t position, vector_t cam_seg) {
+    vector_t ray = sub_vector(position, game->player.pos);
+    double c = get_cos(ray, game->player.dir); // Cosine
+    double s = get_cos(ray, cam_seg);          // Sine
+
+    double distance = norm2(ray);
+    double orth_distance = distance * c; // Orthogonal distance
+    sprite_projection_t _projection = {
+        orth_distance, (WW / 2) * (distance * s) / orth_distance, 700 * 64 / orth_distance};
+    return _projection;
+}
+
+/// Whether a shot through the middle of the screen meets an opaque texel of
+/// the enemy as it is drawn, not only the transparent ones around it
+static bool shot_hits(const prop_t* enemy, vector_t cam_seg) {
+    sprite_projection_t _sprite = project_sprite(enemy->position, cam_seg);
+    if (_sprite.distance <= 0) {
+        return false;
+    }
+    // Texel column under the crosshair, on the middle row of the frame
+    int _u = (int)floor((_sprite.x_offset + _sprite.size / 2) * TILE_WIDTH / _sprite.size);
+    if (_u < 0 || _u >= TILE_WIDTH) {
+        return false;
+    }
+    return asset_opaque(&assets[get_sprite(enemy->type).asset], _u, TILE_HEIGHT / 2);
+}
+
+/// Distance to the wall in the middle of the screen, which stops the shots.
+/// Cast on its own: the frame may not have been drawn.
+static double center_wall_distance() {
+    wall_hit_t _wall = cast_wall((int)WW / 2);
+    return get_cos(_wall.ray, game->player.dir) * get_distance(game->player.pos, _wall.hit);
+}
+
+/// Brings the world to the next frame: the chunks around the player, the
+/// doors, and the gun animation the frame shows
+static void next_frame() {
+    los_new_frame();
+    world_prefetch(game->player.pos);
+    update_doors(game->player.pos);
+
+    int factor = 5;
+    int nb_frame = 4;
+
+    game->gun_offset = 0;
+    if (game->is_firing && game->ammo) {
+        game->gun_offset = game->anim_frame / factor;
+        if (game->gun_state == IDLE) {
+            game->gun_state = LOADING;
+        } else if (game->gun_state == LOADING && game->gun_offset == 3) {
+            game->gun_state = FIRING;
+        } else if (game->gun_state == FIRING) {
+            game->gun_offset += 2;
+            nb_frame = 2;
+        }
+        game->ammo_cpt++;
+        if (game->ammo_cpt == 3) {
+            game->ammo--;
+            game->ammo_cpt = 0;
+        }
+    } else {
+        game->gun_state = IDLE;
+    }
+    game->anim_frame = (game->anim_frame + 1) % (nb_frame * factor);
+}
+
+// ---------------------
+// Core interface
+// ---------------------
+
+// Levels compiled or opened so far, shared by every instance playing them
+typedef struct shared_level {
+    char* path; // NULL for the text maps
+    level_t* level;
+    struct shared_level* next;
+} shared_level_t;
+
+static shared_level_t* levels = NULL;
+static pthread_mutex_t levels_lock = PTHREAD_MUTEX_INITIALIZER;
+
+bool raycaster_init(const char* asset_root, const char* bundle_path, int asset_workers) {
+    bool _loaded = bundle_path != NULL ? load_asset_bundle(bundle_path)
+                                       : load_assets(asset_root, asset_workers);
+    if (!_loaded || !build_palette()) {
+        return false;
+    }
+    los_start();
+    return true;
+}
+
+raycaster_t* raycaster_create() {
+    raycaster_t* rc = calloc(1, sizeof(raycaster_t));
+    if (rc == NULL || !arena_init(&rc->frame_arena, FRAME_ARENA_SIZE)) {
+        fprintf(stderr, "Error at instance creation: out of memory\n");
+        free(rc);
+        return NULL;
+    }
+    rc->player = (player_t){i_pos, i_dir};
+    rc->gun_state = IDLE;
+    rc->ammo = 100;
+    rc->dmg = 1;
+    return rc;
+}
+
+/// Level of the world file, or of the text maps if path is NULL, opened by
+/// the first instance playing it
+static const level_t* shared_level(const char* path) {
+    pthread_mutex_lock(&levels_lock);
+    shared_level_t* entry = levels;
+    while (entry != NULL && !(path == NULL ? entry->path == NULL
+                                           : entry->path != NULL && !strcmp(entry->path, path))) {
+        entry = entry->next;
+    }
+    if (entry == NULL) {
+        level_t* level = path != NULL ? level_open(path)
+                                      : level_open_text("../map", "../sprite_map",
+                                                        "../floor_map", "../ceiling_map");
+        entry = level != NULL ? calloc(1, sizeof(shared_level_t)) : NULL;
+        if (entry != NULL) {
+            entry->path = path != NULL ? strdup(path) : NULL;
+            entry->level = level;
+            entry->next = levels;
+            levels = entry;
+        } else {
+            level_close(level);
+        }
+    }
+    pthread_mutex_unlock(&levels_lock);
+    return entry != NULL ? entry->level : NULL;
+}
+
+bool raycaster_load_level(raycaster_t* rc, const char* world_path) {
+    use_instance(rc);
+    reset_props();
+    reset_doors();
+    flow_field_reset();
+    los_reset();
+    rc->scene.valid = false;
+    rc->player = (player_t){i_pos, i_dir};
+
+    // Only the chunks around the player are paged in
+    const level_t* level = shared_level(world_path);
+    if (level == NULL || !world_open(level)) {
+        return false;
+    }
+    world_prefetch(rc->player.pos);
+    world_sync();
+    next_frame();
+    return true;
+}
+
+/// Moves the player, paging in the chunks around the new position
+void raycaster_set_camera(raycaster_t* rc, vector_t pos, vector_t dir) {
+    use_instance(rc);
+    rc->player.pos = pos;
+    rc->player.dir = dir;
+    world_prefetch(rc->player.pos);
+}
+
+player_t raycaster_camera(const raycaster_t* rc) { return rc->player; }
+
+int raycaster_ammo(const raycaster_t* rc) { return rc->ammo; }
+
+// ----------------------------------------------------------
+// Snapshots: the whole state of a game as one flat blob, this header then
+// one byte per chunk of the level telling if its props were spawned.
+// Chunks, flow field and line of sight answers are derived from it and
+// built again on demand.
+// ----------------------------------------------------------
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t size;  // Of the whole snapshot
+    int32_t width;  // Of the level, which the snapshot is restored into
+    int32_t height;
+    player_t player;
+    uint64_t revision; // Of the walls, given by the world the snapshot was taken in
+    gun_anim_state gun_state;
+    bool is_firing;
+    int32_t ammo;
+    int32_t ammo_cpt;
+    int32_t dmg;
+    int32_t anim_frame;
+    int32_t gun_offset;
+    prop_set_t props;
+    door_set_t doors;
+} snapshot_t;
+
+size_t raycaster_snapshot_size(const raycaster_t* rc) {
+    return sizeof(snapshot_t) + (size_t)rc->world.chunk_cols * rc->world.chunk_rows;
+}
+
+bool raycaster_save(const raycaster_t* rc, void* blob, size_t size) {
+    size_t _size = raycaster_snapshot_size(rc);
+    if (rc->world.level == NULL || size < _size) {
+        fprintf(stderr, "Error at snapshot: %zu bytes needed\n", _size);
+        return false;
+    }
+    snapshot_t* snapshot = blob;
+    memcpy(snapshot->magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
+    snapshot->version = SNAPSHOT_VERSION;
+    snapshot->size = _size;
+    snapshot->width = rc->world.width;
+    snapshot->height = rc->world.height;
+    snapshot->player = rc->player;
+    snapshot->revision = rc->world.revision;
+    snapshot->gun_state = rc->gun_state;
+    snapshot->is_firing = rc->is_firing;
+    snapshot->ammo = rc->ammo;
+    snapshot->ammo_cpt = rc->ammo_cpt;
+    snapshot->dmg = rc->dmg;
+    snapshot->anim_frame = rc->anim_frame;
+    snapshot->gun_offset = rc->gun_offset;
+    snapshot->props = rc->props;
+    snapshot->doors = rc->doors;
+    memcpy(snapshot + 1, rc->world.spawned, _size - sizeof(snapshot_t));
+    return true;
+}
+
+// Tiles whose solidity a restore refreshes one by one: past that many,
+// every resident chunk is rebuilt on its next read instead
+#define RESTORE_DIRTY_TILES 64
+
+typedef struct {
+    int count; // May exceed RESTORE_DIRTY_TILES, only the first ones are kept
+    int cols[RESTORE_DIRTY_TILES];
+    int rows[RESTORE_DIRTY_TILES];
+} dirty_tiles_t;
+
+static void mark_dirty(dirty_tiles_t* dirty, vector_t position) {
+    if (dirty->count < RESTORE_DIRTY_TILES) {
+        dirty->cols[dirty->count] = (int)position.x / TILE_WIDTH;
+        dirty->rows[dirty->count] = (int)position.y / TILE_HEIGHT;
+    }
+    dirty->count++;
+}
+
+/// Tiles whose solidity may differ between the props and doors of the game
+/// and the ones of the snapshot: the tiles of the props standing or
+/// colliding differently at the same index, and of the doors opened
+/// differently. Both frames mostly hold the same props in the same order.
+static void diff_solidity(const snapshot_t* snapshot, dirty_tiles_t* dirty) {
+    const prop_set_t* _old = prop_set;
+    const prop_set_t* _new = &snapshot->props;
+    for (int i = 0; i < _old->prop_number || i < _new->prop_number; i++) {
+        const prop_t* _a = i < _old->prop_number ? &_old->props[i] : NULL;
+        const prop_t* _b = i < _new->prop_number ? &_new->props[i] : NULL;
+        if (_a != NULL && _b != NULL &&
+            (int)_a->position.x / TILE_WIDTH == (int)_b->position.x / TILE_WIDTH &&
+            (int)_a->position.y / TILE_HEIGHT == (int)_b->position.y / TILE_HEIGHT &&
+            prop_collides(_a) == prop_collides(_b)) {
+            continue;
+        }
+        if (_a != NULL) {
+            mark_dirty(dirty, _a->position);
+        }
+        if (_b != NULL) {
+            mark_dirty(dirty, _b->position);
+        }
+    }
+
+    const door_set_t* _old_doors = door_set;
+    const door_set_t* _new_doors = &snapshot->doors;
+    for (int i = 0; i < _old_doors->door_number || i < _new_doors->door_number; i++) {
+        const door_t* _a = i < _old_doors->door_number ? &_old_doors->doors[i] : NULL;
+        const door_t* _b = i < _new_doors->door_number ? &_new_doors->doors[i] : NULL;
+        if (_a != NULL && _b != NULL && _a->col == _b->col && _a->row == _b->row &&
+            (_a->open == TILE_WIDTH) == (_b->open == TILE_WIDTH)) {
+            continue;
+        }
+        if (_a != NULL) {
+            mark_dirty(dirty, (vector_t){_a->col * TILE_WIDTH, _a->row * TILE_HEIGHT});
+        }
+        if (_b != NULL) {
+            mark_dirty(dirty, (vector_t){_b->col * TILE_WIDTH, _b->row * TILE_HEIGHT});
+        }
+    }
+}
+
+bool raycaster_restore(raycaster_t* rc, const void* blob, size_t size) {
+    const snapshot_t* snapshot = blob;
+    size_t _size = raycaster_snapshot_size(rc);
+    if (rc->world.level == NULL || size < sizeof(snapshot_t) ||
+        memcmp(snapshot->magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC)) != 0 ||
+        snapshot->version != SNAPSHOT_VERSION || snapshot->size != _size || size < _size ||
+        snapshot->width != rc->world.width || snapshot->height != rc->world.height) {
+        fprintf(stderr, "Error at snapshot: not taken on this level\n");
+        return false;
+    }
+    use_instance(rc);
+    dirty_tiles_t _dirty = {0};
+    diff_solidity(snapshot, &_dirty);
+
+    rc->player = snapshot->player;
+    rc->gun_state = snapshot->gun_state;
+    rc->is_firing = snapshot->is_firing;
+    rc->ammo = snapshot->ammo;
+    rc->ammo_cpt = snapshot->ammo_cpt;
+    rc->dmg = snapshot->dmg;
+    rc->anim_frame = snapshot->anim_frame;
+    rc->gun_offset = snapshot->gun_offset;
+    rc->props = snapshot->props;
+    rc->doors = snapshot->doors;
+    memcpy(rc->world.spawned, snapshot + 1, _size - sizeof(snapshot_t));
+    rc->world.revision = snapshot->revision;
+
+    // Only the tiles whose props or doors changed get their solidity rebuilt,
+    // paths and sights may all be wrong
+    if (_dirty.count > RESTORE_DIRTY_TILES) {
+        world_reset_solidity();
+    } else {
+        for (int i = 0; i < _dirty.count; i++) {
+            world_update_tile(_dirty.cols[i], _dirty.rows[i]);
+        }
+    }
+    flow_field_reset();
+    los_new_frame();
+
+    // Drawn without being stepped: the chunks around the camera are paged in
+    // here, the props stay the snapshot's
+    world_follow(rc->player.pos);
+    return true;
+}
+
+/// Turns the player with the mouse, then moves them with the keys unless a
+/// wall is in the way
+static void move_player(const frame_input_t* input) {
+    // Angle made by dir vector with horizontal axis (left to right)
+    double angle = (double)input->mouse_delta / 500;
+    vector_t _rot_dir = rotate_vector(game->player.dir, angle);
+    game->player.dir = _rot_dir;
+
+    vector_t _norm_dir = normalize_vector(_rot_dir);
+    vector_t _orth_dir = get_orthogonal(_norm_dir);
+    vector_t _new_forward = mult_vector(_norm_dir, input->step_forward);
+    vector_t _new_side = mult_vector(_orth_dir, input->step_side);
+    vector_t _new_dir = add_vector(_new_forward, _new_side);
+    vector_t _new_pos = add_vector(game->player.pos, _new_dir);
+
+    int _x = (int)_new_pos.x;
+    int _y = (int)_new_pos.y;
+
+    if (!world_blocked(_x / TILE_WIDTH, _y / TILE_HEIGHT)) {
+        game->player.pos.x = _new_pos.x;
+        game->player.pos.y = _new_pos.y;
+    }
+}
+
+void raycaster_move(raycaster_t* rc, const frame_input_t* input) {
+    use_instance(rc);
+    move_player(input);
+}
+
+bool raycaster_step(raycaster_t* rc, const frame_input_t* input) {
+    use_instance(rc);
+    arena_reset(&game->frame_arena);
+    game->step_frames++;
+    int _player_col = (int)game->player.pos.x / TILE_WIDTH;
+    int _player_row = (int)game->player.pos.y / TILE_HEIGHT;
+
+    // ------------------------------------
+    // Check if an enemy has been hit
+    // ------------------------------------
+
+    // Check only the props of the cells in the PVS of the player's tile
+    if (game->is_firing && game->gun_state == FIRING) {
+        double _wall_distance = center_wall_distance();
+        vector_t cam_seg = mult_vector(camera_segment(game->player), tan(FOVR / 2));
+        int* visible_props = arena_alloc(&game->frame_arena, prop_set->prop_number * sizeof(int));
+        if (visible_props == NULL) {
+            fprintf(stderr, "Error at frame arena: %zu bytes are not enough\n",
+                    game->frame_arena.capacity);
+            return false;
+        }
+        int _nb_visible = world_visible_props(_player_col, _player_row, visible_props);
+        for (int v = 0; v < _nb_visible; v++) {
+            prop_t* prop = &prop_set->props[visible_props[v]];
+            if (!is_enemy(prop->type) || prop->state == PROP_DEAD) {
+                continue;
+            }
+            vector_t ray = sub_vector(prop->position, game->player.pos);
+            double cs = get_cos(ray, game->player.dir);
+            double dist = cs * norm2(ray);
+            if (dist < _wall_distance) {
+                if (shot_hits(prop, cam_seg)) { // An enemy has been hit
+                    if (prop->life > 0) {
+                        prop->life -= game->dmg;
+                        prop->state = PROP_CHASING;
+                    } else {
+                        prop->state = PROP_DEAD;
+                        int _col = (int)prop->position.x / TILE_WIDTH;
+                        int _row = (int)prop->position.y / TILE_HEIGHT;
+                        world_update_tile(_col, _row);
+                        flow_field_tile_changed(_col, _row);
+                    }
+                }
+            }
+        }
+    }
+
+    // -----------------------------
+    // Applying the frame input
+    // -----------------------------
+
+    game->is_firing = input->firing;
+
+    if (input->reload) {
+        game->ammo = 100;
+    }
+    if (input->use_door) {
+        door_t* _door = door_in_front();
+        // Never close a door on the player, nor on an enemy standing in it
+        if (_door != NULL && !(_door->open == TILE_WIDTH &&
+                               ((_door->col == (int)game->player.pos.x / TILE_WIDTH &&
+                                 _door->row == (int)game->player.pos.y / TILE_HEIGHT) ||
+                                world_blocked(_door->col, _door->row)))) {
+            toggle_door(_door);
+        }
+    }
+
+    // ------------------------------------
+    // Player movement and collision
+    // ------------------------------------
+
+    move_player(input);
+
+    // ------------------------------------
+    // Enemies spotting the player
+    // ------------------------------------
+
+    int _nb_enemies = 0;
+    while (_nb_enemies < MAX_ENEMIES && prop_set->enemy_index[_nb_enemies] != -1) {
+        _nb_enemies++;
+    }
+    los_query_t* sight_queries = arena_alloc(&game->frame_arena, _nb_enemies * sizeof(los_query_t));
+    int* sight_enemies = arena_alloc(&game->frame_arena, _nb_enemies * sizeof(int));
+    uint32_t* sight_visible =
+        arena_alloc(&game->frame_arena, LOS_WORDS(_nb_enemies) * sizeof(uint32_t));
+    if (sight_queries == NULL || sight_enemies == NULL || sight_visible == NULL) {
+        fprintf(stderr, "Error at frame arena: %zu bytes are not enough\n",
+                game->frame_arena.capacity);
+        return false;
+    }
+
+    // Idle enemies out of the PVS of the player's tile cannot see the player
+    int _nb_sights = 0;
+    int _sight_col = (int)game->player.pos.x / TILE_WIDTH;
+    int _sight_row = (int)game->player.pos.y / TILE_HEIGHT;
+    for (int i = 0; i < _nb_enemies; i++) {
+        prop_t* enemy = &prop_set->props[prop_set->enemy_index[i]];
+        if (enemy->state == PROP_IDLE &&
+            world_visible(_sight_col, _sight_row, (int)enemy->position.x / TILE_WIDTH,
+                          (int)enemy->position.y / TILE_HEIGHT)) {
+            los_query_t _query = {enemy->position, game->player.pos};
+            sight_queries[_nb_sights] = _query;
+            sight_enemies[_nb_sights++] = i;
+        }
+    }
+    los_batch(sight_queries, _nb_sights, sight_visible);
+    for (int q = 0; q < _nb_sights; q++) {
+        if (sight_visible[q / 32] & (1u << (q % 32))) {
+            prop_set->props[prop_set->enemy_index[sight_enemies[q]]].state = PROP_CHASING;
+        }
+    }
+
+    // ------------------------------------
+    // Enemies chasing the player
+    // ------------------------------------
+
+    // The flow field is only rebuilt when the player changes tile, the
+    // tiles the enemies left or entered are repaired
+    flow_field_update(game->player.pos);
+
+    for (int i = 0; i < MAX_ENEMIES && prop_set->enemy_index[i] != -1; i++) {
+        prop_t* enemy = &prop_set->props[prop_set->enemy_index[i]];
+        if (enemy->state == PROP_CHASING) {
+            vector_t _from = enemy->position;
+            enemy->position = flow_field_step(enemy->position, ENEMY_STEP);
+            int _from_col = (int)_from.x / TILE_WIDTH, _from_row = (int)_from.y / TILE_HEIGHT;
+            int _to_col = (int)enemy->position.x / TILE_WIDTH;
+            int _to_row = (int)enemy->position.y / TILE_HEIGHT;
+            if (_from_col != _to_col || _from_row != _to_row) {
+                world_update_tile(_from_col, _from_row);
+                world_update_tile(_to_col, _to_row);
+                flow_field_tile_changed(_from_col, _from_row);
+                flow_field_tile_changed(_to_col, _to_row);
+            }
+        }
+    }
+
+    next_frame();
+    return true;
+}
+
+bool raycaster_draw(raycaster_t* rc, render_backend_t* backend,
+                    const raycaster_outputs_t* outputs) {
+    use_instance(rc);
+    arena_reset(&game->frame_arena);
+    vector_t cam_seg = mult_vector(camera_segment(game->player), tan(FOVR / 2));
+
+    // ---------------
+    // Wall casting
+    // ---------------
+
+    Uint64 _submit_start = SDL_GetPerformanceCounter();
+    // Contains both props and enemies
+    real_world_prop_t* props_to_render =
+        arena_alloc(&game->frame_arena, prop_set->prop_number * sizeof(real_world_prop_t));
+    int* visible_props = arena_alloc(&game->frame_arena, prop_set->prop_number * sizeof(int));
+    if (props_to_render == NULL || visible_props == NULL) {
+        fprintf(stderr, "Error at frame arena: %zu bytes are not enough\n",
+                game->frame_arena.capacity);
+        return false;
+    }
+
+    // The per pixel outputs are written by the CPU rasterizer along with
+    // the pixels, starting from the farthest and emptiest values
+    bool _cpu = backend->framebuffer != NULL;
+    float* _depth = outputs != NULL && _cpu ? outputs->depth : NULL;
+    int32_t* _entities = outputs != NULL && _cpu ? outputs->entities : NULL;
+    for (int i = 0; _depth != NULL && i < WW * WH; i++) {
+        _depth[i] = INFINITY;
+    }
+    if (_entities != NULL) {
+        memset(_entities, 0xff, WW * WH * sizeof(int32_t));
+    }
+    backend->depth = _depth;
+    backend->entities = _entities;
+
+    // Only the sprites and the gun are drawn again over the last scene
+    // while the camera and the doors stand still. The depth of the scene
+    // is not kept: it is cast again when asked for.
+    Uint64 _floor_ticks = 0;
+    bool _reuse = game->scene.valid && _depth == NULL && game->scene.backend == backend &&
+                  game->scene.revision == world->revision &&
+                  game->scene.pos.x == game->player.pos.x &&
+                  game->scene.pos.y == game->player.pos.y &&
+                  game->scene.dir.x == game->player.dir.x &&
+                  game->scene.dir.y == game->player.dir.y &&
+                  backend->restore_scene(backend);
+    if (!_reuse) {
+        _floor_ticks = cast_scene(backend, cam_seg);
+        game->scene_casts++;
+        if (backend->save_scene != NULL) {
+            backend->save_scene(backend);
+            game->scene.valid = true;
+            game->scene.backend = backend;
+            game->scene.pos = game->player.pos;
+            game->scene.dir = game->player.dir;
+            game->scene.revision = world->revision;
+        }
+    }
+
+    // ---------------------------
+    // Rendering props & enemies
+    // ---------------------------
+
+    int _nb_props = 0; // Number of props to render
+    int _player_col = (int)game->player.pos.x / TILE_WIDTH;
+    int _player_row = (int)game->player.pos.y / TILE_HEIGHT;
+
+    // Only the props of the cells in the PVS of the player's tile are visited
+    int _nb_visible = world_visible_props(_player_col, _player_row, visible_props);
+    game->pvs_culled += prop_set->prop_number - _nb_visible;
+
+    for (int v = 0; v < _nb_visible; v++) {
+        int i = visible_props[v];
+        prop_t* prop = &prop_set->props[i];
+        // Ray from player to the prop
+        vector_t ray = sub_vector(prop->position, game->player.pos);
+        double c = get_cos(ray, game->player.dir); // Cosine
+        double phi = acos(c);
+        double distance = norm2(ray);
+        double orth_distance = distance * c;
+
+        if (phi < FOVR / 2) {
+            real_world_prop_t _prop = {*prop, orth_distance, i};
+            props_to_render[_nb_props++] = _prop;
+        }
+    }
+
+    // Sorting props by distance to the player
+    if (_nb_props > 0) {
+        qsort(props_to_render, _nb_props, sizeof(real_world_prop_t), compare_props);
+
+        for (int p = 0; p < _nb_props; p++) {
+            prop_t _prop = props_to_render[p].prop;
+            int _entity = props_to_render[p].index;
+            sprite_projection_t _sprite = project_sprite(_prop.position, cam_seg);
+            double orth_distance = _sprite.distance;
+            double x_offset = _sprite.x_offset;
+            double w = _sprite.size; // Number of column needed
+            double h = _sprite.size;
+
+            asset_id prop_asset = get_sprite(_prop.type).asset;
+
+            for (int x = 0; x < w; x++) {
+                int _x = x * 64 / w;
+                int _sx = (int)(WW / 2 - x_offset - w / 2 + x); // Screen column
+                if (_sx < 0 || _sx >= WW) {
+                    continue;
+                }
+                if (orth_distance < game->wall_distance[_sx]) {
+                    SDL_Rect _src = {_x, 0, 1, TILE_HEIGHT};
+                    if (_prop.type == SOLDIER && _prop.state == PROP_DEAD) {
+                        _src.x += 4 * 64;
+                        _src.y += 5 * 64;
+                    }
+                    column_span_t _span = {_sx, WH / 2 - h / 2, h, prop_asset, _src,
+                                           false, orth_distance, _entity};
+                    backend->draw_sprite_span(backend, &_span);
+                }
+            }
+        }
+    }
+
+    game->submit_ticks += SDL_GetPerformanceCounter() - _submit_start - _floor_ticks;
+    game->submit_frames++;
+
+    // ---------------------
+    // Rendering gun
+    // ---------------------
+
+    const int gun_w = 500;
+    const int gun_h = 500;
+
+    SDL_Rect gun_src = {game->gun_offset * 128, 0, 128, 128};
+    SDL_Rect gun_dst = {(WW - gun_w) / 2, WH - gun_h + 100, gun_w, gun_h};
+    backend->blit_hud(backend, assets[ASSET_GUN].surface, &gun_src, &gun_dst);
+
+    backend->depth = NULL;
+    backend->entities = NULL;
+    if (outputs != NULL && outputs->hits != NULL) {
+        memcpy(outputs->hits, game->wall_hits, sizeof(game->wall_hits));
+    }
+    return true;
+}
+
+bool raycaster_render(raycaster_t* rc, uint8_t* rgba, int pitch,
+                      const raycaster_outputs_t* outputs) {
+    if (rc->memory_backend == NULL) {
+        rc->memory_backend = create_memory_backend();
+        if (rc->memory_backend == NULL) {
+            return false;
+        }
+    }
+    if (!raycaster_draw(rc, rc->memory_backend, outputs)) {
+        return false;
+    }
+    const Uint32* _pixels = rc->memory_backend->framebuffer;
+    for (int y = 0; y < RAYCASTER_HEIGHT; y++) {
+        uint8_t* _out = rgba + (size_t)y * pitch;
+        for (int x = 0; x < RAYCASTER_WIDTH; x++, _out += 4) {
+            Uint32 _p = *_pixels++;
+            _out[0] = _p >> 16;
+            _out[1] = _p >> 8;
+            _out[2] = _p;
+            _out[3] = _p >> 24;
+        }
+    }
+    return true;
+}
+
+// ----------------------------------------------------------
+// Lockstep: the calls over several instances are spread on a pool of
+// workers, each one taking the next instance left until none is. The pool
+// serves one caller at a time, the others run their calls alone.
+// ----------------------------------------------------------
+
+typedef struct {
+    raycaster_t** games;
+    const frame_input_t* inputs; // NULL when rendering
+    uint8_t** rgba;
+    int pitch;
+    const raycaster_outputs_t* outputs;
+    int count;
+    atomic_int next;
+    atomic_bool ok;
+} lockstep_t;
+
+static pthread_t workers[RAYCASTER_MAX_THREADS];
+static int worker_count = 0;
+static bool workers_started = false;
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t wake = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t done = PTHREAD_COND_INITIALIZER;
+static pthread_mutex_t taken = PTHREAD_MUTEX_INITIALIZER; // Held by the caller using the pool
+static lockstep_t* job = NULL;
+static unsigned long job_number = 0;
+static int busy = 0;
+static bool stopping = false;
+
+static void run_lockstep(lockstep_t* step) {
+    for (int i; (i = atomic_fetch_add(&step->next, 1)) < step->count;) {
+        bool _ok = step->inputs != NULL
+                       ? raycaster_step(step->games[i], &step->inputs[i])
+                       : raycaster_render(step->games[i], step->rgba[i], step->pitch,
+                                          step->outputs != NULL ? &step->outputs[i] : NULL);
+        if (!_ok) {
+            atomic_store(&step->ok, false);
+        }
+    }
+}
+
+static void* lockstep_worker(void* arg) {
+    (void)arg;
+    unsigned long _seen = 0;
+    pthread_mutex_lock(&lock);
+    for (;;) {
+        while (job_number == _seen && !stopping) {
+            pthread_cond_wait(&wake, &lock);
+        }
+        if (stopping) {
+            break;
+        }
+        _seen = job_number;
+        lockstep_t* _step = job;
+        pthread_mutex_unlock(&lock);
+        run_lockstep(_step);
+        pthread_mutex_lock(&lock);
+        if (--busy == 0) {
+            pthread_cond_signal(&done);
+        }
+    }
+    pthread_mutex_unlock(&lock);
+    return NULL;
+}
+
+/// Starts the workers on the first lockstep call, one per spare core
+static void start_workers() {
+    if (workers_started) {
+        return;
+    }
+    workers_started = true;
+    long _cores = sysconf(_SC_NPROCESSORS_ONLN);
+    int _wanted = _cores > 1 ? _cores - 1 : 0;
+    if (_wanted > RAYCASTER_MAX_THREADS) {
+        _wanted = RAYCASTER_MAX_THREADS;
+    }
+    stopping = false;
+    for (worker_count = 0; worker_count < _wanted; worker_count++) {
+        if (pthread_create(&workers[worker_count], NULL, lockstep_worker, NULL) != 0) {
+            fprintf(stderr, "Error at lockstep: %d workers only\n", worker_count);
+            break;
+        }
+    }
+}
+
+/// Runs a lockstep call on the pool, or on the caller alone while another
+/// thread is using the pool
+static bool lockstep(lockstep_t* step) {
+    atomic_init(&step->next, 0);
+    atomic_init(&step->ok, true);
+    bool _pooled = step->count > 1 && pthread_mutex_trylock(&taken) == 0;
+    if (_pooled) {
+        start_workers();
+    }
+    if (_pooled && worker_count > 0) {
+        pthread_mutex_lock(&lock);
+        busy = worker_count;
+        job = step;
+        job_number++;
+        pthread_cond_broadcast(&wake);
+        pthread_mutex_unlock(&lock);
+
+        run_lockstep(step);
+
+        pthread_mutex_lock(&lock);
+        while (busy > 0) {
+            pthread_cond_wait(&done, &lock);
+        }
+        pthread_mutex_unlock(&lock);
+    } else {
+        run_lockstep(step);
+    }
+    if (_pooled) {
+        pthread_mutex_unlock(&taken);
+    }
+    return atomic_load(&step->ok);
+}
+
+bool raycaster_step_all(raycaster_t** rcs, const frame_input_t* inputs, int count) {
+    lockstep_t _step = {rcs, inputs, NULL, 0, NULL, count};
+    return lockstep(&_step);
+}
+
+bool raycaster_render_all(raycaster_t** rcs, uint8_t** rgba, int pitch,
+                          const raycaster_outputs_t* outputs, int count) {
+    lockstep_t _step = {rcs, NULL, rgba, pitch, outputs, count};
+    return lockstep(&_step);
+}
+
+// ---------------------
+// Statistics and exit
+// ---------------------
+
+void raycaster_print_stats(const raycaster_t* rc, const render_backend_t* backend) {
+    if (rc->submit_frames > 0) {
+        double _ms = 1000.0 * rc->submit_ticks / SDL_GetPerformanceFrequency() / rc->submit_frames;
+        printf("[ STATS ] %s backend, walls & sprites: %.3f ms/frame, %.1f submissions/frame\n",
+               backend->name, _ms, (double)backend->submissions / rc->submit_frames);
+        printf("[ STATS ] frame arena: %zu of %zu bytes at most\n", rc->frame_arena.high_water,
+               rc->frame_arena.capacity);
+        printf("[ STATS ] scene: cast on %lu of %lu frames, reused on the others\n",
+               rc->scene_casts, (unsigned long)rc->submit_frames);
+        if (rc->scene_casts > 0) {
+            printf("[ STATS ] walls: %.1f rays cast/scene for %d columns\n",
+                   (double)rc->wall_rays / rc->scene_casts, (int)WW);
+            printf("[ STATS ] floor: %.3f ms/scene, %.1f%% of the pixels hidden by walls "
+                   "skipped\n",
+                   1000.0 * rc->floor_ticks / SDL_GetPerformanceFrequency() / rc->scene_casts,
+                   100.0 * rc->floor_skipped / rc->scene_casts / (WW * (WH / 2 + 1)));
+        }
+        printf("[ STATS ] PVS: %.1f props rejected/frame\n",
+               (double)rc->pvs_culled / rc->submit_frames);
+    }
+    if (rc->step_frames > 0) {
+        printf("[ STATS ] line of sight: %.1f queries/frame, %.1f walked\n",
+               (double)rc->los.stats.queries / rc->step_frames,
+               (double)rc->los.stats.walks / rc->step_frames);
+    }
+    if (rc->submit_frames > 0 || rc->step_frames > 0) {
+        printf("[ STATS ] world: %lu chunk loads, %lu stalls\n", rc->world.loads,
+               rc->world.stalls);
+    }
+}
+
+void raycaster_destroy(raycaster_t* rc) {
+    if (rc == NULL) {
+        return;
+    }
+    use_instance(rc);
+    world_close();
+    los_free();
+    arena_free(&rc->frame_arena);
+    if (NULL != rc->memory_backend) {
+        rc->memory_backend->destroy(rc->memory_backend);
+    }
+    free(rc);
+    game = NULL;
+    world = NULL;
+    prop_set = NULL;
+    door_set = NULL;
+    flow_field = NULL;
+    los = NULL;
+}
+
+void raycaster_quit() {
+    if (workers_started) {
+        pthread_mutex_lock(&lock);
+        stopping = true;
+        pthread_cond_broadcast(&wake);
+        pthread_mutex_unlock(&lock);
+        for (int i = 0; i < worker_count; i++) {
+            pthread_join(workers[i], NULL);
+        }
+        worker_count = 0;
+        workers_started = false;
+    }
+    los_stop();
+    world_stop_loaders();
+    while (levels != NULL) {
+        shared_level_t* entry = levels;
+        levels = entry->next;
+        level_close(entry->level);
+        free(entry->path);
+        free(entry);
+    }
+    free_assets();
+}
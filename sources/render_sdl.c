@@ -0,0 +1,323 @@
+#include "geometry.h"
+#include "render.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+// SDL_Renderer backend: the walls and sprites are either copied column by
+// column, or batched into one SDL_RenderGeometry call per texture
+typedef struct {
+    render_backend_t base;
+    SDL_Renderer* renderer;
+    SDL_Texture* background; // Streaming texture receiving the floor and ceiling
+    Uint32* background_pixels;
+    bool background_pending; // Not uploaded to the renderer yet
+    bool batched;
+    geometry_batch_t wall_batch;
+    geometry_batch_t sprite_batch;
+    SDL_Surface* hud_surface; // Last non-asset surface blitted, and its texture
+    SDL_Texture* hud_texture;
+    SDL_Texture* scene; // Render target the floor, ceiling and walls are drawn into
+    bool scene_saved;
+} sdl_backend_t;
+
+static void flush_batch(sdl_backend_t* self, geometry_batch_t* batch) {
+    if (batch->index_number > 0) {
+        batch_flush(self->renderer, batch);
+        self->base.submissions++;
+    }
+}
+
+/// Draws what has been queued so far, in order: background, walls, sprites
+static void flush_pending(sdl_backend_t* self) {
+    if (self->background_pending) {
+        SDL_UpdateTexture(self->background, NULL, self->background_pixels,
+                          (int)WW * sizeof(Uint32));
+        SDL_RenderCopy(self->renderer, self->background, NULL, NULL);
+        self->base.submissions++;
+        self->background_pending = false;
+    }
+    flush_batch(self, &self->wall_batch);
+    flush_batch(self, &self->sprite_batch);
+}
+
+static Uint32* sdl_begin_frame(render_backend_t* base) {
+    sdl_backend_t* self = (sdl_backend_t*)base;
+    self->background_pending = true;
+    if (NULL != self->scene) {
+        // Drawn off screen, then copied on screen by save_scene
+        SDL_SetRenderTarget(self->renderer, self->scene);
+    }
+    return self->background_pixels;
+}
+
+/// Same light as the colormaps of the CPU backends, as a texture modulation
+static Uint8 span_intensity(const column_span_t* span) {
+    return colormap_intensity(colormap_level(span->distance), span->shaded);
+}
+
+static void push_span(sdl_backend_t* self, geometry_batch_t* batch, const column_span_t* span) {
+    asset_t* asset = &assets[span->asset];
+    if (batch->texture != asset->texture) {
+        flush_batch(self, batch);
+        batch_begin(batch, asset->texture, asset->surface->w, asset->surface->h);
+    }
+    Uint8 _light = span_intensity(span);
+    SDL_FRect dst = {span->x, span->top, 1, span->height};
+    batch_push_quad(batch, &span->src, &dst, (SDL_Color){_light, _light, _light, 0xff});
+}
+
+static void copy_span(sdl_backend_t* self, const column_span_t* span) {
+    SDL_Texture* texture = assets[span->asset].texture;
+    Uint8 _light = span_intensity(span);
+    SDL_SetTextureColorMod(texture, _light, _light, _light);
+    // Rounded like the software rasterizer, down to the row the floor starts
+    // on: truncating top and height apart could leave a row under the wall
+    int _top = (int)span->top;
+    SDL_Rect dst = {span->x, _top, 1, (int)(span->top + span->height) - _top};
+    SDL_RenderCopy(self->renderer, texture, &span->src, &dst);
+    self->base.submissions++;
+}
+
+static void sdl_draw_column(render_backend_t* base, const column_span_t* span) {
+    sdl_backend_t* self = (sdl_backend_t*)base;
+    if (self->background_pending) {
+        flush_pending(self);
+    }
+
+    // Shading and fog modulate the texels (vertex color when batched)
+    // instead of costing a second draw
+    if (self->batched) {
+        push_span(self, &self->wall_batch, span);
+    } else {
+        copy_span(self, span);
+    }
+}
+
+static void sdl_draw_sprite_span(render_backend_t* base, const column_span_t* span) {
+    sdl_backend_t* self = (sdl_backend_t*)base;
+    if (self->background_pending || self->wall_batch.index_number > 0) {
+        flush_pending(self);
+    }
+
+    // Only the opaque runs of the column are copied, without blending:
+    // empty columns cost no draw at all
+    const asset_t* asset = &assets[span->asset];
+    double _scale = span->height / span->src.h;
+    int _v_end = span->src.y + span->src.h;
+    for (Uint32 r = asset->column_runs[span->src.x]; r < asset->column_runs[span->src.x + 1];
+         r++) {
+        int _start = asset->runs[r].start < span->src.y ? span->src.y : asset->runs[r].start;
+        int _end = asset->runs[r].end > _v_end ? _v_end : asset->runs[r].end;
+        if (_start >= _end) {
+            continue;
+        }
+        column_span_t _run = *span;
+        _run.src.y = _start;
+        _run.src.h = _end - _start;
+        _run.top = span->top + (_start - span->src.y) * _scale;
+        _run.height = _run.src.h * _scale;
+
+        if (self->batched) {
+            // Sprites are drawn back to front: a texture change ends the
+            // current batch to keep the overlapping order right
+            push_span(self, &self->sprite_batch, &_run);
+        } else {
+            copy_span(self, &_run);
+        }
+    }
+}
+
+static void sdl_blit_hud(render_backend_t* base, SDL_Surface* surface, const SDL_Rect* src,
+                         const SDL_Rect* dst) {
+    sdl_backend_t* self = (sdl_backend_t*)base;
+    flush_pending(self);
+
+    // Assets already have their texture, any other surface (the glyph
+    // atlas) keeps one until another surface comes
+    SDL_Texture* texture = NULL;
+    for (int i = 0; i < ASSET_COUNT; i++) {
+        if (assets[i].surface == surface) {
+            texture = assets[i].texture;
+        }
+    }
+    if (texture != NULL) {
+        SDL_SetTextureColorMod(texture, 0xff, 0xff, 0xff); // Left fogged by copy_span
+    } else {
+        if (self->hud_surface != surface) {
+            if (self->hud_texture != NULL) {
+                SDL_DestroyTexture(self->hud_texture);
+            }
+            self->hud_texture = SDL_CreateTextureFromSurface(self->renderer, surface);
+            self->hud_surface = surface;
+        }
+        texture = self->hud_texture;
+    }
+    SDL_RenderCopy(self->renderer, texture, src, dst);
+    base->submissions++;
+}
+
+static bool sdl_read_pixels(render_backend_t* base, Uint32* pixels) {
+    sdl_backend_t* self = (sdl_backend_t*)base;
+    flush_pending(self);
+    // Must happen before SDL_RenderPresent, the back buffer is undefined after
+    return SDL_RenderReadPixels(self->renderer, NULL, SDL_PIXELFORMAT_ARGB8888, pixels,
+                                (int)WW * sizeof(Uint32)) == 0;
+}
+
+/// Renderer copies of the images, kept in the assets
+static bool create_asset_textures(SDL_Renderer* renderer) {
+    for (int i = 0; i < ASSET_COUNT; i++) {
+        if (assets[i].kind != ASSET_IMAGE) {
+            continue;
+        }
+        assets[i].texture = SDL_CreateTextureFromSurface(renderer, assets[i].surface);
+        if (assets[i].texture == NULL) {
+            fprintf(stderr, "Error on SDL_CreateTextureFromSurface: %s\n", SDL_GetError());
+            return false;
+        }
+        // Walls and sprites are only drawn by opaque runs: the gun alone
+        // needs its alpha
+        SDL_SetTextureBlendMode(assets[i].texture,
+                                i == ASSET_GUN ? SDL_BLENDMODE_BLEND : SDL_BLENDMODE_NONE);
+    }
+    return true;
+}
+
+/// Destroys the renderer copies, before the renderer goes
+static void free_asset_textures() {
+    for (int i = 0; i < ASSET_COUNT; i++) {
+        if (assets[i].texture != NULL) {
+            SDL_DestroyTexture(assets[i].texture);
+            assets[i].texture = NULL;
+        }
+    }
+}
+
+/// Target textures lose their pixels when the renderer resets them (a lost
+/// Direct3D device): the next frame casts the scene again
+static int forget_scene(void* data, SDL_Event* event) {
+    if (event->type == SDL_RENDER_TARGETS_RESET || event->type == SDL_RENDER_DEVICE_RESET) {
+        ((sdl_backend_t*)data)->scene_saved = false;
+    }
+    return 0;
+}
+
+static void sdl_save_scene(render_backend_t* base) {
+    sdl_backend_t* self = (sdl_backend_t*)base;
+    flush_pending(self);
+    SDL_SetRenderTarget(self->renderer, NULL);
+    SDL_RenderCopy(self->renderer, self->scene, NULL, NULL);
+    base->submissions++;
+    self->scene_saved = true;
+}
+
+/// One copy of the target texture instead of the floor upload and a draw
+/// per wall column (or per wall texture when batched)
+static bool sdl_restore_scene(render_backend_t* base) {
+    sdl_backend_t* self = (sdl_backend_t*)base;
+    if (!self->scene_saved) {
+        return false;
+    }
+    SDL_RenderCopy(self->renderer, self->scene, NULL, NULL);
+    base->submissions++;
+    return true;
+}
+
+static void sdl_present(render_backend_t* base) {
+    sdl_backend_t* self = (sdl_backend_t*)base;
+    flush_pending(self);
+    SDL_RenderPresent(self->renderer);
+}
+
+static void sdl_destroy(render_backend_t* base) {
+    sdl_backend_t* self = (sdl_backend_t*)base;
+    batch_free(&self->wall_batch);
+    batch_free(&self->sprite_batch);
+    free_asset_textures();
+    if (NULL != self->hud_texture) {
+        SDL_DestroyTexture(self->hud_texture);
+    }
+    if (NULL != self->scene) {
+        SDL_DelEventWatch(forget_scene, self);
+        SDL_DestroyTexture(self->scene);
+    }
+    if (NULL != self->background) {
+        SDL_DestroyTexture(self->background);
+    }
+    if (NULL != self->renderer) {
+        SDL_DestroyRenderer(self->renderer);
+    }
+    if (NULL != base->window) {
+        SDL_DestroyWindow(base->window);
+    }
+    free(self->background_pixels);
+    free(self);
+}
+
+render_backend_t* create_sdl_backend(bool batched, bool software_renderer) {
+    sdl_backend_t* self = calloc(1, sizeof(sdl_backend_t));
+    if (NULL == self) {
+        fprintf(stderr, "Error at backend allocation\n");
+        return NULL;
+    }
+    render_backend_t* base = &self->base;
+
+    base->name = batched ? "geometry" : "sdl";
+    base->begin_frame = sdl_begin_frame;
+    base->draw_column = sdl_draw_column;
+    base->draw_sprite_span = sdl_draw_sprite_span;
+    base->blit_hud = sdl_blit_hud;
+    base->read_pixels = sdl_read_pixels;
+    base->present = sdl_present;
+    base->destroy = sdl_destroy;
+    self->batched = batched;
+
+    if (0 != SDL_InitSubSystem(SDL_INIT_VIDEO)) {
+        fprintf(stderr, "Error on SDL_Init: %s", SDL_GetError());
+        goto Error;
+    }
+
+    base->window = SDL_CreateWindow("Raycaster", SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED,
+                                    WW, WH, SDL_WINDOW_SHOWN);
+    if (NULL == base->window) {
+        fprintf(stderr, "Error on SDL_CreateWindow: %s", SDL_GetError());
+        goto Error;
+    }
+
+    Uint32 renderer_flags = software_renderer ? SDL_RENDERER_SOFTWARE : SDL_RENDERER_ACCELERATED;
+    self->renderer = SDL_CreateRenderer(base->window, -1, renderer_flags);
+    if (NULL == self->renderer) {
+        fprintf(stderr, "Error on SDL_CreateRenderer: %s", SDL_GetError());
+        goto Error;
+    }
+    SDL_SetRenderDrawBlendMode(self->renderer, SDL_BLENDMODE_BLEND);
+
+    self->background = SDL_CreateTexture(self->renderer, SDL_PIXELFORMAT_ARGB8888,
+                                         SDL_TEXTUREACCESS_STREAMING, WW, WH);
+    self->background_pixels = calloc((int)WW * (int)WH, sizeof(Uint32));
+    if (NULL == self->background || NULL == self->background_pixels) {
+        fprintf(stderr, "Error on SDL_CreateTexture: %s", SDL_GetError());
+        goto Error;
+    }
+
+    // Renderers without target textures recast the scene every frame
+    if (SDL_RenderTargetSupported(self->renderer)) {
+        self->scene = SDL_CreateTexture(self->renderer, SDL_PIXELFORMAT_ARGB8888,
+                                        SDL_TEXTUREACCESS_TARGET, WW, WH);
+    }
+    if (NULL != self->scene) {
+        SDL_SetTextureBlendMode(self->scene, SDL_BLENDMODE_NONE);
+        SDL_AddEventWatch(forget_scene, self);
+        base->save_scene = sdl_save_scene;
+        base->restore_scene = sdl_restore_scene;
+    }
+
+    if (!create_asset_textures(self->renderer)) {
+        goto Error;
+    }
+    return base;
+
+Error:
+    sdl_destroy(base);
+    return NULL;
+}
@@ -0,0 +1,232 @@
+#include "render.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// CPU rasterizer writing into an ARGB8888 framebuffer, kept for the caller:
+// it never touches SDL video. The front-end shows it through a window in
+// render_window.c.
+typedef struct {
+    render_backend_t base;
+    Uint32* pixels;
+    Uint32* scene; // Floor, ceiling and walls of the last frame that cast them
+    bool scene_saved;
+} software_backend_t;
+
+#define SCREEN_W ((int)WW)
+#define SCREEN_H ((int)WH)
+
+static Uint32* software_begin_frame(render_backend_t* base) {
+    software_backend_t* self = (software_backend_t*)base;
+    return self->pixels;
+}
+
+static void rasterize_span(software_backend_t* self, const column_span_t* span) {
+    if (span->x < 0 || span->x >= SCREEN_W || span->height <= 0) {
+        return;
+    }
+    asset_t* asset = &assets[span->asset];
+
+    int _y0 = span->top < 0 ? 0 : (int)span->top;
+    int _y1 = span->top + span->height > SCREEN_H ? SCREEN_H : (int)(span->top + span->height);
+    double _step = span->src.h / span->height;
+    double _v = span->src.y + (_y0 - span->top) * _step;
+
+    // 8-bit texels, shaded and fogged by the colormap while expanding them.
+    // Columns are stored contiguously: stepping down the span walks memory.
+    const Uint8* _texels = asset->columns + span->src.x * asset->surface->h;
+    const Uint32* _colormap = get_colormap(span->distance, span->shaded);
+    Uint32* _out = self->pixels + _y0 * SCREEN_W + span->x;
+    float* _depth = self->base.depth;
+    int32_t* _entities = self->base.entities;
+    int _v_max = span->src.y + span->src.h - 1;
+
+    // The first row starts above the span when it is not pixel aligned:
+    // far columns (more than a texel per pixel) would read before src.y
+    if (_v < span->src.y) {
+        _v = span->src.y;
+    }
+    for (int y = _y0; y < _y1; y++, _out += SCREEN_W, _v += _step) {
+        int _tv = (int)_v > _v_max ? _v_max : (int)_v;
+        *_out = _colormap[_texels[_tv]];
+        if (_depth != NULL) {
+            _depth[_out - self->pixels] = span->distance;
+        }
+        if (_entities != NULL) {
+            _entities[_out - self->pixels] = span->entity;
+        }
+    }
+}
+
+/// Texel row sampled n rows below the first one of a span, which samples v0
+static inline int span_texel(double v0, double step, int n, int v_max) {
+    int _v = (int)(v0 + n * step);
+    return _v > v_max ? v_max : _v;
+}
+
+/// Writes the opaque runs of the column only: empty columns cost nothing,
+/// and the texels drawn need no transparency test
+static void rasterize_sprite_span(software_backend_t* self, const column_span_t* span) {
+    if (span->x < 0 || span->x >= SCREEN_W || span->height <= 0) {
+        return;
+    }
+    asset_t* asset = &assets[span->asset];
+
+    int _y0 = span->top < 0 ? 0 : (int)span->top;
+    int _y1 = span->top + span->height > SCREEN_H ? SCREEN_H : (int)(span->top + span->height);
+    double _step = span->src.h / span->height;
+    double _v0 = span->src.y + (_y0 - span->top) * _step;
+    if (_v0 < span->src.y) {
+        _v0 = span->src.y; // Same first row as rasterize_span
+    }
+
+    const Uint8* _texels = asset->columns + span->src.x * asset->surface->h;
+    const Uint32* _colormap = get_colormap(span->distance, span->shaded);
+    float* _depth = self->base.depth;
+    int32_t* _entities = self->base.entities;
+    int _v_end = span->src.y + span->src.h;
+
+    for (Uint32 r = asset->column_runs[span->src.x]; r < asset->column_runs[span->src.x + 1];
+         r++) {
+        int _start = asset->runs[r].start < span->src.y ? span->src.y : asset->runs[r].start;
+        int _end = asset->runs[r].end > _v_end ? _v_end : asset->runs[r].end;
+        if (_start >= _end) {
+            continue;
+        }
+
+        // First screen row sampling the run: estimated, then adjusted to
+        // the texels the rows actually sample
+        double _estimate = _y0 + (_start - _v0) / _step;
+        int y = _estimate < _y0 ? _y0 : _estimate > _y1 ? _y1 : (int)_estimate;
+        while (y > _y0 && span_texel(_v0, _step, y - 1 - _y0, _v_end - 1) >= _start) {
+            y--;
+        }
+        while (y < _y1 && span_texel(_v0, _step, y - _y0, _v_end - 1) < _start) {
+            y++;
+        }
+
+        for (int _tv; y < _y1 && (_tv = span_texel(_v0, _step, y - _y0, _v_end - 1)) < _end;
+             y++) {
+            int _pixel = y * SCREEN_W + span->x;
+            self->pixels[_pixel] = _colormap[_texels[_tv]];
+            if (_depth != NULL) {
+                _depth[_pixel] = span->distance;
+            }
+            if (_entities != NULL) {
+                _entities[_pixel] = span->entity;
+            }
+        }
+    }
+}
+
+static void software_draw_column(render_backend_t* base, const column_span_t* span) {
+    rasterize_span((software_backend_t*)base, span);
+}
+
+static void software_draw_sprite_span(render_backend_t* base, const column_span_t* span) {
+    rasterize_sprite_span((software_backend_t*)base, span);
+}
+
+/// Nearest-neighbour scaled copy of src over dst, skipping transparent texels
+static void software_blit_hud(render_backend_t* base, SDL_Surface* surface, const SDL_Rect* src,
+                              const SDL_Rect* dst) {
+    software_backend_t* self = (software_backend_t*)base;
+
+    // Text surfaces are palettized, everything is sampled as ARGB8888
+    SDL_Surface* image = surface;
+    if (surface->format->format != SDL_PIXELFORMAT_ARGB8888) {
+        image = SDL_ConvertSurfaceFormat(surface, SDL_PIXELFORMAT_ARGB8888, 0);
+        if (image == NULL) {
+            return;
+        }
+    }
+
+    SDL_Rect _src = src ? *src : (SDL_Rect){0, 0, image->w, image->h};
+    SDL_Rect _dst = dst ? *dst : (SDL_Rect){0, 0, _src.w, _src.h};
+    int _stride = image->pitch / sizeof(Uint32);
+
+    for (int y = 0; y < _dst.h; y++) {
+        int _sy = _dst.y + y;
+        if (_sy < 0 || _sy >= SCREEN_H) {
+            continue;
+        }
+        int _ty = _src.y + y * _src.h / _dst.h;
+        const Uint32* _row = (const Uint32*)image->pixels + _ty * _stride;
+        for (int x = 0; x < _dst.w; x++) {
+            int _sx = _dst.x + x;
+            if (_sx < 0 || _sx >= SCREEN_W) {
+                continue;
+            }
+            Uint32 _p = _row[_src.x + x * _src.w / _dst.w];
+            if ((_p >> 24) >= 0x80) {
+                self->pixels[_sy * SCREEN_W + _sx] = _p;
+            }
+        }
+    }
+
+    if (image != surface) {
+        SDL_FreeSurface(image);
+    }
+}
+
+static void software_save_scene(render_backend_t* base) {
+    software_backend_t* self = (software_backend_t*)base;
+    memcpy(self->scene, self->pixels, SCREEN_W * SCREEN_H * sizeof(Uint32));
+    self->scene_saved = true;
+}
+
+static bool software_restore_scene(render_backend_t* base) {
+    software_backend_t* self = (software_backend_t*)base;
+    if (!self->scene_saved) {
+        return false;
+    }
+    memcpy(self->pixels, self->scene, SCREEN_W * SCREEN_H * sizeof(Uint32));
+    return true;
+}
+
+static bool software_read_pixels(render_backend_t* base, Uint32* pixels) {
+    software_backend_t* self = (software_backend_t*)base;
+    memcpy(pixels, self->pixels, SCREEN_W * SCREEN_H * sizeof(Uint32));
+    return true;
+}
+
+static void software_present(render_backend_t* base) {
+    (void)base; // The frame stays in the framebuffer
+}
+
+static void software_destroy(render_backend_t* base) {
+    software_backend_t* self = (software_backend_t*)base;
+    free(self->pixels);
+    free(self->scene);
+    free(self);
+}
+
+render_backend_t* create_memory_backend() {
+    software_backend_t* self = calloc(1, sizeof(software_backend_t));
+    if (NULL == self) {
+        fprintf(stderr, "Error at framebuffer allocation\n");
+        return NULL;
+    }
+    render_backend_t* base = &self->base;
+
+    base->name = "memory";
+    base->begin_frame = software_begin_frame;
+    base->draw_column = software_draw_column;
+    base->draw_sprite_span = software_draw_sprite_span;
+    base->blit_hud = software_blit_hud;
+    base->save_scene = software_save_scene;
+    base->restore_scene = software_restore_scene;
+    base->read_pixels = software_read_pixels;
+    base->present = software_present;
+    base->destroy = software_destroy;
+
+    self->pixels = calloc(SCREEN_W * SCREEN_H, sizeof(Uint32));
+    self->scene = calloc(SCREEN_W * SCREEN_H, sizeof(Uint32));
+    if (NULL == self->pixels || NULL == self->scene) {
+        fprintf(stderr, "Error at framebuffer allocation\n");
+        software_destroy(base);
+        return NULL;
+    }
+    base->framebuffer = self->pixels;
+    return base;
+}
@@ -0,0 +1,61 @@
+#include "render.h"
+#include <stdio.h>
+
+// The software backend: the memory backend of the core, whose frames are
+// copied to the window surface on present. Only the front-end opens it.
+
+static void (*destroy_rasterizer)(render_backend_t* self) = NULL;
+
+static void window_present(render_backend_t* base) {
+    SDL_Surface* screen = SDL_GetWindowSurface(base->window);
+    if (NULL == screen) {
+        return;
+    }
+    if (SDL_MUSTLOCK(screen) && 0 != SDL_LockSurface(screen)) {
+        return;
+    }
+    // Converted in place of a blit: the floor is written without alpha
+    SDL_ConvertPixels((int)WW, (int)WH, SDL_PIXELFORMAT_ARGB8888, base->framebuffer,
+                      (int)WW * sizeof(Uint32), screen->format->format, screen->pixels,
+                      screen->pitch);
+    if (SDL_MUSTLOCK(screen)) {
+        SDL_UnlockSurface(screen);
+    }
+    SDL_UpdateWindowSurface(base->window);
+    base->submissions++;
+}
+
+static void window_destroy(render_backend_t* base) {
+    if (NULL != base->window) {
+        SDL_DestroyWindow(base->window);
+        base->window = NULL;
+    }
+    destroy_rasterizer(base);
+}
+
+render_backend_t* create_software_backend() {
+    render_backend_t* base = create_memory_backend();
+    if (NULL == base) {
+        return NULL;
+    }
+    base->name = "software";
+    destroy_rasterizer = base->destroy;
+    base->present = window_present;
+    base->destroy = window_destroy;
+
+    if (0 != SDL_InitSubSystem(SDL_INIT_VIDEO)) {
+        fprintf(stderr, "Error on SDL_Init: %s", SDL_GetError());
+        goto Error;
+    }
+    base->window = SDL_CreateWindow("Raycaster", SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED,
+                                    WW, WH, SDL_WINDOW_SHOWN);
+    if (NULL == base->window) {
+        fprintf(stderr, "Error on SDL_CreateWindow: %s", SDL_GetError());
+        goto Error;
+    }
+    return base;
+
+Error:
+    window_destroy(base);
+    return NULL;
+}
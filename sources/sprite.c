@@ -5,22 +5,20 @@
 #define SPRITE_WIDTH 64
 #define SPRITE_HEIGHT 64
 
-const sprite_t wooden_barrel_sprite = {"../wooden_barrel.png", SPRITE_WIDTH, SPRITE_HEIGHT, true,
+const sprite_t wooden_barrel_sprite = {ASSET_WOODEN_BARREL, SPRITE_WIDTH, SPRITE_HEIGHT, true,
                                        -1};
-const sprite_t iron_barrel_sprite = {"../iron_barrel.png", SPRITE_WIDTH, SPRITE_HEIGHT, true, -1};
-const sprite_t dinner_table_sprite = {"../dinner_table.png", SPRITE_WIDTH, SPRITE_HEIGHT, true, -1};
-const sprite_t well_water_sprite = {"../well.png", SPRITE_WIDTH, SPRITE_HEIGHT, true, -1};
-const sprite_t armor_sprite = {"../armor.png", SPRITE_WIDTH, SPRITE_HEIGHT, true, -1};
-const sprite_t furnace_sprite = {"../furnace.png", SPRITE_WIDTH, SPRITE_HEIGHT, true, -1};
-const sprite_t pillar_sprite = {"../pillar.png", SPRITE_WIDTH, SPRITE_HEIGHT, true, -1};
-const sprite_t soldier_sprite = {"../guard.png", SPRITE_WIDTH, SPRITE_HEIGHT, true, 10};
-const sprite_t empty_sprite = {"", 0, 0, false};
+const sprite_t iron_barrel_sprite = {ASSET_IRON_BARREL, SPRITE_WIDTH, SPRITE_HEIGHT, true, -1};
+const sprite_t dinner_table_sprite = {ASSET_DINNER_TABLE, SPRITE_WIDTH, SPRITE_HEIGHT, true, -1};
+const sprite_t well_water_sprite = {ASSET_WELLWATER, SPRITE_WIDTH, SPRITE_HEIGHT, true, -1};
+const sprite_t armor_sprite = {ASSET_ARMOR, SPRITE_WIDTH, SPRITE_HEIGHT, true, -1};
+const sprite_t furnace_sprite = {ASSET_FURNACE, SPRITE_WIDTH, SPRITE_HEIGHT, true, -1};
+const sprite_t pillar_sprite = {ASSET_PILLAR, SPRITE_WIDTH, SPRITE_HEIGHT, true, -1};
+const sprite_t soldier_sprite = {ASSET_SOLDIER, SPRITE_WIDTH, SPRITE_HEIGHT, true, 10};
+const sprite_t empty_sprite = {ASSET_NONE, 0, 0, false, -1};
 
 static sprite_type sprite_char(const char c);
 
-prop_t props[MAP_HEIGHT * MAP_WIDTH];
-int enemy_index[100];
-int prop_number = 0;
+_Thread_local prop_set_t* prop_set = NULL;
 
 bool is_enemy(sprite_type t) {
     switch (t) {
@@ -31,43 +29,79 @@ bool is_enemy(sprite_type t) {
     }
 }
 
-/// Loads props' and enemies' sprites
-void load_sprite_map(const char* path) {
-    for (int i = 0; i < 100; i++) {
-        enemy_index[i] = -1;
+void reset_props() {
+    for (int i = 0; i < MAX_ENEMIES; i++) {
+        prop_set->enemy_index[i] = -1;
     }
+    prop_set->prop_number = 0;
+    prop_set->enemy_number = 0;
+}
+
+/// True if a prop spawned on the tile is still in the game
+static bool spawned_from(int col, int row) {
+    for (int i = 0; i < prop_set->prop_number; i++) {
+        if (prop_set->props[i].origin_col == col && prop_set->props[i].origin_row == row) {
+            return true;
+        }
+    }
+    return false;
+}
 
-    FILE* map_file;
-    map_file = fopen(path, "r");
-    char line[MAP_WIDTH + 1];
-    int row = 0;
-    int _en_idx = 0;
-
-    while (fgets(line, MAP_WIDTH + 1, map_file) && row < MAP_HEIGHT) {
-        if (strcmp(line, "\n")) {
-            for (int col = 0; col < MAP_WIDTH; col++) {
-                sprite_type _sp_type = sprite_char(line[col]);
-                sprite_t sp = get_sprite(_sp_type);
-                if (_sp_type != EMPTY) {
-                    prop_t _prop = {
-                        _sp_type, {col * 64 + 32, row * 64 + 32}, PROP_IDLE, sp.life_span};
-                    props[prop_number] = _prop;
-                    if (is_enemy(_sp_type)) {
-                        enemy_index[_en_idx++] = prop_number;
-                    }
-                    prop_number++;
-                }
+/// Brings the props' and enemies' sprites of a freshly loaded chunk, whose
+/// top-left tile is at (col, row), into the game. Those kept since the
+/// chunk was last evicted are not spawned twice.
+void spawn_props(int col, int row, const chunk_data_t* chunk) {
+    for (int y = 0; y < CHUNK_SIZE; y++) {
+        for (int x = 0; x < CHUNK_SIZE; x++) {
+            sprite_type _sp_type = sprite_char(chunk->sprites[y][x]);
+            if (_sp_type == EMPTY || spawned_from(col + x, row + y)) {
+                continue;
             }
-            row++;
+            if (prop_set->prop_number == MAX_PROPS) {
+                fprintf(stderr, "Error at prop spawning: more than %d props\n", MAX_PROPS);
+                return;
+            }
+            sprite_t sp = get_sprite(_sp_type);
+            vector_t _position = {(col + x) * 64 + 32, (row + y) * 64 + 32};
+            prop_t _prop = {_sp_type, _position, PROP_IDLE, sp.life_span, col + x, row + y};
+            prop_set->props[prop_set->prop_number] = _prop;
+            if (is_enemy(_sp_type)) {
+                prop_set->enemy_index[prop_set->enemy_number++] = prop_set->prop_number;
+            }
+            prop_set->prop_number++;
         }
     }
+}
 
-    fclose(map_file);
+/// Drops the idle props spawned in the chunk whose top-left tile is at
+/// (col, row), which is being evicted: spawn_props brings them back as
+/// they were. Dead and chasing ones stay in the game.
+void despawn_props(int col, int row) {
+    int _kept = 0;
+    int _enemies = prop_set->enemy_number;
+    prop_set->enemy_number = 0;
+    for (int i = 0; i < prop_set->prop_number; i++) {
+        prop_t* _prop = &prop_set->props[i];
+        if (_prop->state == PROP_IDLE && _prop->origin_col >= col &&
+            _prop->origin_col < col + CHUNK_SIZE && _prop->origin_row >= row &&
+            _prop->origin_row < row + CHUNK_SIZE) {
+            continue;
+        }
+        prop_set->props[_kept] = *_prop;
+        if (is_enemy(_prop->type)) {
+            prop_set->enemy_index[prop_set->enemy_number++] = _kept;
+        }
+        _kept++;
+    }
+    prop_set->prop_number = _kept;
+    for (int i = prop_set->enemy_number; i < _enemies; i++) {
+        prop_set->enemy_index[i] = -1;
+    }
 }
 
 prop_t* sprite_at_pos(int x, int y) {
-    for (int i = 0; i < prop_number; i++) {
-        prop_t* _prop = &props[i];
+    for (int i = 0; i < prop_set->prop_number; i++) {
+        prop_t* _prop = &prop_set->props[i];
         if ((int)_prop->position.x / 64 == x / 64 && (int)_prop->position.y / 64 == y / 64) {
             return _prop;
         }
@@ -75,6 +109,23 @@ prop_t* sprite_at_pos(int x, int y) {
     return NULL;
 }
 
+/// True if the prop stops whoever walks on its tile: alive, with collision
+bool prop_collides(const prop_t* prop) {
+    return prop->state != PROP_DEAD && get_sprite(prop->type).collision;
+}
+
+/// True if a live prop with collision stands on the tile
+bool prop_blocks(int col, int row) {
+    for (int i = 0; i < prop_set->prop_number; i++) {
+        prop_t* _prop = &prop_set->props[i];
+        if ((int)_prop->position.x / TILE_WIDTH == col &&
+            (int)_prop->position.y / TILE_HEIGHT == row && prop_collides(_prop)) {
+            return true;
+        }
+    }
+    return false;
+}
+
 static sprite_type sprite_char(const char c) {
     switch (c) {
     case 'w':
@@ -129,8 +180,8 @@ int compare_props(const void* a, const void* b) {
     double da = ra.distance;
     double db = rb.distance;
 
-    if (da == db)
-        return 0;
+    if (da == db) // Whatever order the props were gathered in
+        return ra.index - rb.index;
     else if (da > db)
         return -1;
     else